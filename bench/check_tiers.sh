@@ -0,0 +1,19 @@
+#!/bin/sh
+# Copyright (c) 2015 Caleb Jones
+# Checks that a program prints the same thing whether it's interpreted,
+# tiered up to the JIT after its first call, or compiled up front.
+#
+#     bench/check_tiers.sh [lensc] [file.ls]
+LENSC=${1:-./lensc}
+FILE=${2:-$(dirname "$0")/../test.ls}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+"$LENSC" "$FILE" --interpret --tier-up=0 > "$DIR/interpret" 2>&1
+echo "exit $?" >> "$DIR/interpret"
+"$LENSC" "$FILE" --interpret --tier-up=1 > "$DIR/tier-up" 2>&1
+echo "exit $?" >> "$DIR/tier-up"
+"$LENSC" "$FILE" --run --no-cache > "$DIR/run" 2>&1
+echo "exit $?" >> "$DIR/run"
+diff -u "$DIR/interpret" "$DIR/tier-up" || exit 1
+diff -u "$DIR/interpret" "$DIR/run" || exit 1
+echo "$FILE: the interpreter, --tier-up=1 and --run agree"
@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+# Copyright (c) 2015 Caleb Jones
+"""Writes a large Lens program to stdout, for timing the compiler.
+
+    bench/gen_large.py [functions] [statements] [seed]
+
+Each function does some arithmetic on its arguments and calls at most one
+function defined before it, so a call costs at most one call per function
+before it. main loops over the last function `functions` times. Run it
+with --eval-steps=0, or the calls in main are worked out while compiling.
+"""
+import random
+import sys
+
+
+def function(out, rng, index, statements):
+    out.write('def f%d(a: i64, b: i64) -> i64:\n' % index)
+    names = ['a', 'b']
+    call = rng.randrange(statements) if index > 0 else -1
+    for i in range(statements):
+        x, y = rng.choice(names), rng.choice(names)
+        op = rng.choice(['+', '-', '*'])
+        value = '%s %s %s + %d' % (x, op, y, rng.randrange(1, 100))
+        if i == call:
+            value = 'f%d(%s, %s / 7)' % (rng.randrange(index), x, y)
+        names.append('x%d' % i)
+        out.write('    let x%d = %s\n' % (i, value))
+    last = names[-1]
+    out.write('    if %s < b:\n' % last)
+    out.write('        return %s + a\n' % last)
+    out.write('    else:\n')
+    out.write('        return %s - %s\n\n' % (last, rng.choice(names)))
+
+
+def main():
+    functions = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+    statements = int(sys.argv[2]) if len(sys.argv) > 2 else 20
+    rng = random.Random(int(sys.argv[3]) if len(sys.argv) > 3 else 1)
+    out = sys.stdout
+    for i in range(functions):
+        function(out, rng, i, statements)
+    last = functions - 1
+    out.write('def loop(n: i64, acc: i64) -> i64:\n')
+    out.write('    if n == 0:\n')
+    out.write('        return acc\n')
+    out.write('    else:\n')
+    out.write('        return loop(n - 1, acc + f%d(n, acc))\n\n' % last)
+    out.write('printi64(loop(%d, 0))\n' % functions)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Copyright (c) 2015 Caleb Jones
+# Times each -O level compiling a generated program, and running
+# bench/fib40.ls.
+#
+#     bench/levels.sh [lensc] [functions]
+#
+# The compile time is "codegen" plus "optimize" from the first run of each
+# level, and the run time is "run" from the second.
+LENSC=${1:-./lensc}
+FUNCTIONS=${2:-2000}
+FIB=$(dirname "$0")/fib40.ls
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+python3 "$(dirname "$0")/gen_large.py" "$FUNCTIONS" > "$DIR/large.ls" || exit 1
+for level in 0 1 2 3 s; do
+    echo "-O$level"
+    "$LENSC" "$DIR/large.ls" -O$level --eval-steps=0 --time -c \
+        -o "$DIR/large.o" || exit 1
+    "$LENSC" "$FIB" --run -O$level --eval-steps=0 --no-cache --time || exit 1
+done
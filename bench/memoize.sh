@@ -0,0 +1,14 @@
+#!/bin/sh
+# Copyright (c) 2015 Caleb Jones
+# Times running bench/fib40.ls at -O2 with and without --memoize.
+#
+#     bench/memoize.sh [lensc]
+#
+# --eval-steps=0 stops fib(40) being worked out while compiling, so "run"
+# is the time the generated code takes.
+LENSC=${1:-./lensc}
+FIB=$(dirname "$0")/fib40.ls
+for flags in "" --memoize; do
+    echo "-O2 $flags"
+    "$LENSC" "$FIB" --run -O2 --eval-steps=0 $flags --time || exit 1
+done
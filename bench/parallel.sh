@@ -0,0 +1,20 @@
+#!/bin/sh
+# Copyright (c) 2015 Caleb Jones
+# Times compiling a generated program at -O2 with 1, 2, 4 and 8 threads.
+#
+#     bench/parallel.sh [lensc] [functions]
+#
+# From -j2 up, "codegen" is the part spread over the threads: generating
+# each batch of functions and running the -O2 pipeline over it. "optimize"
+# is the serial part after the batches are linked. With -j1 all of the
+# optimizing is in "optimize".
+LENSC=${1:-./lensc}
+FUNCTIONS=${2:-2000}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+python3 "$(dirname "$0")/gen_large.py" "$FUNCTIONS" > "$DIR/large.ls" || exit 1
+for jobs in 1 2 4 8; do
+    echo "-j$jobs"
+    "$LENSC" "$DIR/large.ls" -O2 -j$jobs --eval-steps=0 --time -c \
+        -o "$DIR/large.o" || exit 1
+done
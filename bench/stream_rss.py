@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+# Copyright (c) 2015 Caleb Jones
+"""Checks that --stream reads a file in the same memory whatever its size.
+
+    bench/stream_rss.py [lensc] [lines...]
+
+Each program is that many comment lines and one statement, so everything
+but the Reader is the same size, and compiles it with --stream. Prints the
+peak RSS of each, and fails if the largest is more than 10% over the
+smallest.
+"""
+import os
+import sys
+import tempfile
+
+
+def peak_rss_kb(command):
+    """Runs `command` and returns its peak RSS in KB."""
+    pid = os.fork()
+    if pid == 0:
+        devnull = os.open(os.devnull, os.O_WRONLY)
+        os.dup2(devnull, 1)
+        os.execvp(command[0], command)
+    _, status, usage = os.wait4(pid, 0)
+    if status != 0:
+        sys.exit('%s failed' % ' '.join(command))
+    return usage.ru_maxrss
+
+
+def main():
+    lensc = sys.argv[1] if len(sys.argv) > 1 else './lensc'
+    sizes = [int(n) for n in sys.argv[2:]] or [1000, 10000000]
+    peaks = []
+    with tempfile.TemporaryDirectory() as dir:
+        for lines in sizes:
+            path = os.path.join(dir, 'comments.ls')
+            with open(path, 'w') as out:
+                out.write('# a comment line\n' * (lines - 1))
+                out.write('printi64(1)\n')
+            peak = peak_rss_kb([lensc, path, '--stream', '-O0'])
+            print('%10d lines %8d KB' % (lines, peak))
+            peaks.append(peak)
+    if max(peaks) > min(peaks) * 1.1:
+        sys.exit('peak RSS grew with the input')
+
+
+if __name__ == '__main__':
+    main()
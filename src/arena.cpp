@@ -0,0 +1,35 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/arena.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+Arena::Arena() : cursor(NULL), limit(NULL), used(0) {}
+
+Arena::~Arena() {
+    for (auto iter = blocks.begin(); iter != blocks.end(); iter++) {
+        free(*iter);
+    }
+}
+
+void *Arena::allocate_slow(size_t size, size_t align) {
+    // Oversized requests get a block to themselves, so that they don't
+    // waste the rest of the current block
+    size_t block_size = kBlockSize;
+    if (size + align > kBlockSize / 4) block_size = size + align;
+    char *block = static_cast<char*>(malloc(block_size));
+    if (block == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        abort();
+    }
+    blocks.push_back(block);
+    if (block_size != kBlockSize) {
+        size_t padding = -reinterpret_cast<size_t>(block) & (align - 1);
+        used += size;
+        return block + padding;
+    }
+    cursor = block;
+    limit = block + block_size;
+    return allocate(size, align);
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_ARENA_H_
+#define LENS_ARENA_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A fixed size array that lives in an Arena. Copying one just copies the
+// pointer to the items.
+template <typename T>
+class ArenaArray {
+    T *items;
+    size_t count;
+ public:
+    ArenaArray() : items(NULL), count(0) {}
+    ArenaArray(T *items, size_t count) : items(items), count(count) {}
+    T *begin() const { return items; }
+    T *end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T &operator[](size_t index) const { return items[index]; }
+    T &back() const { return items[count - 1]; }
+};
+
+// A bump allocator that owns everything allocated from it, and frees it all
+// at once when it's destroyed. Destructors of the objects inside are never
+// run, so anything put in an Arena must not own memory outside of it. The
+// AST follows this rule: nodes only point at other nodes and ArenaArrays.
+class Arena {
+    static const size_t kBlockSize = 64 * 1024;
+    std::vector<char*> blocks;
+    char *cursor;
+    char *limit;
+    size_t used;
+    void *allocate_slow(size_t size, size_t align);
+
+ public:
+    Arena();
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena &operator=(const Arena&) = delete;
+
+    void *allocate(size_t size, size_t align) {
+        // Round the cursor up to the alignment
+        size_t padding = -reinterpret_cast<size_t>(cursor) & (align - 1);
+        if (size + padding > static_cast<size_t>(limit - cursor)) {
+            return allocate_slow(size, align);
+        }
+        char *result = cursor + padding;
+        cursor = result + size;
+        used += size;
+        return result;
+    }
+
+    template <typename T, typename... Args>
+    T *make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T)))
+            T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    ArenaArray<T> copy(const T *items, size_t count) {
+        if (count == 0) return ArenaArray<T>();
+        T *copied = static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+        for (size_t i = 0; i < count; i++) {
+            new (&copied[i]) T(items[i]);
+        }
+        return ArenaArray<T>(copied, count);
+    }
+
+    // Moves everything after `mark` off the end of `stack` into the arena.
+    // Lets a parser build up lists of unknown length on one reused vector.
+    template <typename T>
+    ArenaArray<T> pop_array(std::vector<T> *stack, size_t mark) {
+        ArenaArray<T> result = copy(stack->data() + mark, stack->size() - mark);
+        stack->resize(mark);
+        return result;
+    }
+
+    // Bytes handed out so far, not counting padding or unused block space
+    size_t bytes_used() const { return used; }
+};
+
+#endif  // LENS_ARENA_H_
@@ -0,0 +1,39 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_ARITH_H_
+#define LENS_ARITH_H_
+
+#include <cstdint>
+
+// Lens arithmetic on i64s, for the code that works values out itself
+// instead of generating IR: the constant folder, the interpreter and the
+// VM. It has to give the same results as the generated code, so it wraps
+// around like LLVM's does instead of overflowing. Nothing here depends on
+// LLVM.
+
+inline int64_t wrap(uint64_t value) { return static_cast<int64_t>(value); }
+
+inline int64_t wrapping_add(int64_t L, int64_t R) {
+    return wrap(static_cast<uint64_t>(L) + static_cast<uint64_t>(R));
+}
+
+inline int64_t wrapping_sub(int64_t L, int64_t R) {
+    return wrap(static_cast<uint64_t>(L) - static_cast<uint64_t>(R));
+}
+
+inline int64_t wrapping_mul(int64_t L, int64_t R) {
+    return wrap(static_cast<uint64_t>(L) * static_cast<uint64_t>(R));
+}
+
+// R must not be 0, which callers report as an error. INT64_MIN / -1
+// overflows, and wraps around to INT64_MIN.
+inline int64_t wrapping_div(int64_t L, int64_t R) {
+    if (R == -1) return wrap(0 - static_cast<uint64_t>(L));
+    return L / R;
+}
+
+// Only the low 6 bits of R count, so a shift of 64 or more isn't undefined
+inline int64_t wrapping_shl(int64_t L, int64_t R) {
+    return wrap(static_cast<uint64_t>(L) << (R & 63));
+}
+
+#endif  // LENS_ARITH_H_
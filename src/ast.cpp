@@ -4,9 +4,11 @@
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
+#include "src/codegen.h"
 #include "src/tokenizer.h"
 
 // #include "llvm/IR/Verifier.h"
@@ -22,58 +24,36 @@
 
 using namespace llvm;
 
-void generate_prelude(Module *mod);
-
-Module *_TheModule;
-Module *TheModule() {
-    if (_TheModule == NULL) {
-        _TheModule = new Module("Whatever", getGlobalContext());
-        generate_prelude(_TheModule);
-    }
-    return _TheModule;
-}
-IRBuilder<> Builder(getGlobalContext());
-std::map<std::string, AllocaInst*> NamedValues;
-
-void generate_prelude(Module *mod) {
-    // "C" printf(fmt: ^str, args...) -> void
-    std::vector<Type*> printf_args = {Builder.getInt8Ty()->getPointerTo()};
-
-    FunctionType *printf_type =
-        FunctionType::get(Builder.getInt32Ty(), printf_args, true);
-    Constant *printf_func = mod->getOrInsertFunction("printf", printf_type);
-
-    // printi64(n: i64) -> void
-    std::vector<Type*> argtypes;
-    argtypes.push_back(Builder.getInt64Ty());
-    std::vector<Type*> v = {Type::getInt64Ty(getGlobalContext())};
-    FunctionType *printi64_type = FunctionType::get(
-        Type::getVoidTy(getGlobalContext()),
-        v,
-        false);
-    Function *printi64 = Function::Create(printi64_type,
-                                          Function::ExternalLinkage,
-                                          "printi64",
-                                          mod);
-    printi64->arg_begin()->setName("n");
-    BasicBlock *bb = BasicBlock::Create(getGlobalContext(), "entry", printi64);
-    Builder.SetInsertPoint(bb);
-    Value *fmtstr = Builder.CreateGlobalStringPtr("%li\n");
-    Builder.CreateCall2(printf_func, fmtstr, printi64->arg_begin());
-    Builder.CreateRetVoid();
-}
-
 // ========================================================================= //
 // Numbers
 // ========================================================================= //
-NumberAST::NumberAST(double number) : value(number) {}
+NumberAST::NumberAST(int64_t number)
+    : is_integer(true), integer_value(number), float_value(number) {}
+
+// Everything is an i64 for now, so float literals are truncated (saturating
+// instead of overflowing)
+static int64_t truncate_to_i64(double number) {
+    if (number >= 9223372036854775807.0) return INT64_MAX;
+    if (number <= -9223372036854775808.0) return INT64_MIN;
+    if (number != number) return 0;  // NaN
+    return static_cast<int64_t>(number);
+}
+
+NumberAST::NumberAST(double number)
+    : is_integer(false), integer_value(truncate_to_i64(number)),
+      float_value(number) {}
 
 void NumberAST::print(std::ostream *out) const {
-    *out << value;
+    if (is_integer) {
+        *out << integer_value;
+    } else {
+        *out << float_value;
+    }
 }
 
 Value *NumberAST::expr_codegen() {
-    return ConstantInt::get(getGlobalContext(), APInt(64, value));
+    return ConstantInt::get(Type::getInt64Ty(TheContext()),
+                            integer_value, true);
 }
 
 // int NumberAST::type() {
@@ -83,18 +63,14 @@ Value *NumberAST::expr_codegen() {
 // ========================================================================= //
 // Variables
 // ========================================================================= //
-VariableAST::VariableAST(std::string str) : name(str) {}
+VariableAST::VariableAST(Symbol name) : name(name) {}
 
 void VariableAST::print(std::ostream *out) const {
-    *out << name;
+    *out << Symbols().name(name);
 }
 
 Value *VariableAST::expr_codegen() {
-    auto ptr = NamedValues.find(name);
-    if (ptr == NamedValues.end()) {
-        return ERROR("Unknown variable name '%s'", name.c_str());
-    }
-    return Builder.CreateLoad(NamedValues[name], name);
+    return variable_codegen(name);
 }
 
 // int VariableAST::type() {
@@ -107,10 +83,19 @@ Value *VariableAST::expr_codegen() {
 BinaryExprAST::BinaryExprAST(ExprAST *lhs, int op, ExprAST *rhs)
     : op(op), lhs(lhs), rhs(rhs) {}
 
+std::string binary_op_name(int op) {
+    switch (op) {
+    case tokEq: return "==";
+    case tokIneq: return "!=";
+    case OP_SHIFT_LEFT: return "<<";
+    default: return std::string(1, static_cast<char>(op));
+    }
+}
+
 void BinaryExprAST::print(std::ostream *out) const {
     *out << "(";
     lhs->print(out);
-    *out << " " << static_cast<char>(op) << " ";
+    *out << " " << binary_op_name(op) << " ";
     rhs->print(out);
     *out << ")";
 }
@@ -119,18 +104,7 @@ Value *BinaryExprAST::expr_codegen() {
     Value *L = lhs->expr_codegen();
     Value *R = rhs->expr_codegen();
     if (L == NULL || R == NULL) return NULL;
-
-    switch (op) {
-    case '+': return Builder.CreateAdd(L, R, "addtmp");
-    case '-': return Builder.CreateSub(L, R, "subtmp");
-    case '*': return Builder.CreateMul(L, R, "multmp");
-    case '/': return Builder.CreateSDiv(L, R, "divtmp");
-    case '<': return Builder.CreateICmpSLT(L, R, "lttmp");
-    case '>': return Builder.CreateICmpSGT(L, R, "gttmp");
-    case tokEq: return Builder.CreateICmpEQ(L, R, "eqtmp");
-    case tokNotEq: return Builder.CreateICmpNE(L, R, "neqtmp");
-    default: return ERROR("invalid binary operator");
-    }
+    return binary_op_codegen(op, L, R);
 }
 
 // int BinaryExprAST::type() {
@@ -140,11 +114,11 @@ Value *BinaryExprAST::expr_codegen() {
 // ========================================================================= //
 // Function Calls
 // ========================================================================= //
-CallAST::CallAST(std::string name, std::vector<ExprAST*> args)
+CallAST::CallAST(Symbol name, ArenaArray<ExprAST*> args)
     : name(name), args(args) {}
 
 void CallAST::print(std::ostream *out) const {
-    *out << name << "(";
+    *out << Symbols().name(name) << "(";
     for (auto iter = args.begin(); iter != args.end(); iter++) {
         (*iter)->print(out);
         *out << ", ";
@@ -153,15 +127,8 @@ void CallAST::print(std::ostream *out) const {
 }
 
 Value *CallAST::expr_codegen() {
-    Function *callee_function = TheModule()->getFunction(name);
-    if (callee_function == NULL) {
-        return ERROR("unknown function '%s' referenced", name.c_str());
-    }
-
-    if (callee_function->arg_size() != args.size()) {
-        return ERROR("incorrect number of arguments (%s expected %li, %li given)",
-                     name.c_str(), callee_function->arg_size(), args.size());
-    }
+    Value *callee = callee_codegen(name, args.size());
+    if (callee == NULL) return NULL;
 
     std::vector<Value*> argv;
     for (unsigned i = 0, e = args.size(); i != e; i++) {
@@ -169,7 +136,16 @@ Value *CallAST::expr_codegen() {
         if (argv.back() == NULL) return NULL;
     }
 
-    return Builder.CreateCall(callee_function, argv);
+    return TheBuilder().CreateCall(callee, argv);
+}
+
+bool CallAST::return_codegen() {
+    std::vector<Value*> argv;
+    for (unsigned i = 0, e = args.size(); i != e; i++) {
+        argv.push_back(args[i]->expr_codegen());
+        if (argv.back() == NULL) return false;
+    }
+    return return_call_codegen(name, argv);
 }
 
 // int CallAST::type() {
@@ -179,45 +155,40 @@ Value *CallAST::expr_codegen() {
 // ========================================================================= //
 // Assignment
 // ========================================================================= //
-AssignmentAST::AssignmentAST(std::string name, ExprAST *rhs)
+AssignmentAST::AssignmentAST(Symbol name, ExprAST *rhs)
     : name(name), rhs(rhs) {}
 
 void AssignmentAST::print(std::ostream *out) const {
-    *out << "let " << name << " = ";
+    *out << "let " << Symbols().name(name) << " = ";
     rhs->print(out);
 }
 
 bool AssignmentAST::codegen() {
-    // TODO(Caleb Jones): Implement
-    // Is this a correct implementation?
-    auto ptr = Builder.CreateAlloca(Type::getInt64Ty(getGlobalContext()),
-                                    nullptr, name);
     auto value = rhs->expr_codegen();
     if (value == NULL) return false;
-
-    Builder.CreateStore(value, ptr);
-    // value->setName(name);
-    NamedValues[name] = ptr;
+    bind_variable(name, value);
     return true;
 }
 
 // ========================================================================= //
 // Reassignment
 // ========================================================================= //
-ReassignAST::ReassignAST(std::string name, ExprAST *rhs)
+ReassignAST::ReassignAST(Symbol name, ExprAST *rhs)
     : name(name), rhs(rhs) {}
 
 void ReassignAST::print(std::ostream *out) const {
-    *out << name << " = ";
+    *out << Symbols().name(name) << " = ";
     rhs->print(out);
 }
 
 bool ReassignAST::codegen() {
     auto value = rhs->expr_codegen();
     if (value == NULL) return false;
-    if (NamedValues.find(name) == NamedValues.end()) return false;
-    Builder.CreateStore(value, NamedValues[name]);
-    return true;
+    return reassign_codegen(name, value);
+}
+
+void ReassignAST::find_reassigned(std::set<Symbol> *names) const {
+    names->insert(name);
 }
 
 // ========================================================================= //
@@ -231,14 +202,20 @@ void ReturnAST::print(std::ostream *out) const {
 }
 
 bool ReturnAST::codegen() {
-    // TODO(Caleb Jones): Implement
-    // Is this the proper implementation? Who knows!
+    if (rvalue->type() == CALL_AST) {
+        return static_cast<CallAST*>(rvalue)->return_codegen();
+    }
     auto result = rvalue->expr_codegen();
     if (result == NULL) return false;
-    Builder.CreateRet(result);
+    TheBuilder().CreateRet(result);
     return true;
 }
 
+bool ReturnAST::returns_call_to(Symbol name) const {
+    return rvalue->type() == CALL_AST &&
+           static_cast<CallAST*>(rvalue)->callee() == name;
+}
+
 // int ReturnAST::type() {
 //     return RETURN_AST;
 // }
@@ -247,8 +224,8 @@ bool ReturnAST::codegen() {
 // Conditional
 // ========================================================================= //
 IfElseAST::IfElseAST(ExprAST *cond,
-                     std::vector<StatementAST*> ifbody,
-                     std::vector<StatementAST*> elsebody)
+                     ArenaArray<StatementAST*> ifbody,
+                     ArenaArray<StatementAST*> elsebody)
     : condition(cond), ifbody(ifbody), elsebody(elsebody) {}
 
 void IfElseAST::print(std::ostream* out) const {
@@ -265,7 +242,7 @@ void IfElseAST::print(std::ostream* out) const {
 }
 
 bool IfElseAST::codegen() {
-    Function *fn = Builder.GetInsertBlock()->getParent();
+    Function *fn = TheBuilder().GetInsertBlock()->getParent();
 
     // Generate the basic blocks of the conditional
     // if <cond>:
@@ -273,99 +250,102 @@ bool IfElseAST::codegen() {
     // else:
     //     <elsebb>
     // <mergebb>
-    BasicBlock *ifbb = BasicBlock::Create(getGlobalContext(), "if", fn);
-    BasicBlock *elsebb = BasicBlock::Create(getGlobalContext(), "else");
-    BasicBlock *mergebb = BasicBlock::Create(getGlobalContext(), "ifcont");
+    BasicBlock *ifbb = BasicBlock::Create(TheContext(), "if", fn);
+    BasicBlock *elsebb = BasicBlock::Create(TheContext(), "else");
+    BasicBlock *mergebb = BasicBlock::Create(TheContext(), "ifcont");
 
     // Generate the code for <cond>
     Value *condval = condition->expr_codegen();
     if (condval == NULL) return ERRORB("failed generating condition for if");
 
-    Builder.CreateCondBr(condval, ifbb, elsebb);
+    TheBuilder().CreateCondBr(condval, ifbb, elsebb);
+
+    // Variables bound in a branch only live until the end of it, since
+    // their values don't exist on the other path
+    std::map<Symbol, Variable> outer_scope = Codegen().named_values;
 
-    Builder.SetInsertPoint(ifbb);
+    TheBuilder().SetInsertPoint(ifbb);
     for (auto iter = ifbody.begin(); iter != ifbody.end(); iter++) {
         bool success = (*iter)->codegen();
         if (!success) return ERRORB("failed generating statement in if");
     }
+    Codegen().named_values = outer_scope;
     // Branch back to the merge block only if the code doesn't return directly
     // out of the block. (LLVM IR doesn't like to have a branch after a return
     // because then that's a return in middle of a block)
-    if (ifbody.back()->type() != RETURN_AST) Builder.CreateBr(mergebb);
+    if (ifbody.back()->type() != RETURN_AST) TheBuilder().CreateBr(mergebb);
 
     // Codegen can change the current block (nested if, for example)
     // Here we move ifbb back to the right block.
-    ifbb = Builder.GetInsertBlock();
+    ifbb = TheBuilder().GetInsertBlock();
 
     // Add the else to the back of the function
     fn->getBasicBlockList().push_back(elsebb);
 
-    Builder.SetInsertPoint(elsebb);
+    TheBuilder().SetInsertPoint(elsebb);
     for (auto iter = elsebody.begin(); iter != elsebody.end(); iter++) {
         bool success = (*iter)->codegen();
         if (!success) return ERRORB("failed generating statement in if");
     }
+    Codegen().named_values = outer_scope;
     // Branch back to the merge block only if the code doesn't return directly
     // out of the block. (LLVM IR doesn't like to have a branch after a return
     // because then that's a return in middle of a block)
-    if (elsebody.back()->type() != RETURN_AST) Builder.CreateBr(mergebb);
+    if (elsebody.back()->type() != RETURN_AST) TheBuilder().CreateBr(mergebb);
 
     // Codegen can change the current block (nested if, for example)
-    elsebb = Builder.GetInsertBlock();
+    elsebb = TheBuilder().GetInsertBlock();
 
     // Add our merge block to the back of the function
     fn->getBasicBlockList().push_back(mergebb);
-    Builder.SetInsertPoint(mergebb);
+    TheBuilder().SetInsertPoint(mergebb);
 
     return true;
 }
 
+bool IfElseAST::returns_call_to(Symbol name) const {
+    for (auto iter = ifbody.begin(); iter != ifbody.end(); iter++) {
+        if ((*iter)->returns_call_to(name)) return true;
+    }
+    for (auto iter = elsebody.begin(); iter != elsebody.end(); iter++) {
+        if ((*iter)->returns_call_to(name)) return true;
+    }
+    return false;
+}
+
+void IfElseAST::find_reassigned(std::set<Symbol> *names) const {
+    for (auto iter = ifbody.begin(); iter != ifbody.end(); iter++) {
+        (*iter)->find_reassigned(names);
+    }
+    for (auto iter = elsebody.begin(); iter != elsebody.end(); iter++) {
+        (*iter)->find_reassigned(names);
+    }
+}
+
 // ========================================================================= //
 // Function Prototypes
 // ========================================================================= //
-PrototypeAST::PrototypeAST(std::string name, std::vector<std::string> args)
+PrototypeAST::PrototypeAST(Symbol name, ArenaArray<Symbol> args)
     : name(name), args(args) {}
 
 std::ostream& operator<<(std::ostream& out, PrototypeAST const& ast) {
-    out << ast.name << "(";
+    out << Symbols().name(ast.name) << "(";
     for (auto iter = ast.args.begin(); iter != ast.args.end(); iter++) {
-        out << *iter << ", ";
+        out << Symbols().name(*iter) << ", ";
     }
     out << ")";
     return out;
 }
 
 Function *PrototypeAST::codegen() {
-    // Make the function type: (Currently just (double, double, ...) -> double)
-    std::vector<Type*> ints(args.size(),
-                            Type::getInt64Ty(getGlobalContext()));
-    auto ret_type = Type::getInt64Ty(getGlobalContext());
-    if (name == "main") {
-        ret_type = Type::getInt32Ty(getGlobalContext());
-    }
-    FunctionType *ftype = FunctionType::get(
-        ret_type,
-        ints,
-        false);
-
-    Function *f = Function::Create(ftype,
-                                   Function::ExternalLinkage,
-                                   name,
-                                   TheModule());
-
-    // Check for name conflicts
-    if (f->getName() != name) {
-        return ERROR("redifinition of a function");
-    }
-
-    return f;
+    return declare_function(name, args.size());
 }
 
 // ========================================================================= //
 // Functions
 // ========================================================================= //
-FunctionAST::FunctionAST(PrototypeAST *proto, std::vector<StatementAST*> body)
-    : proto(proto), body(body) {}
+FunctionAST::FunctionAST(PrototypeAST *proto, ArenaArray<StatementAST*> body)
+    : proto(proto), body(body), memoize(false) {}
 
 std::ostream& operator<<(std::ostream& out, FunctionAST const& ast) {
     out << *ast.proto << ":\n";
@@ -377,26 +357,22 @@ std::ostream& operator<<(std::ostream& out, FunctionAST const& ast) {
 }
 
 Function *FunctionAST::codegen() {
-    std::cout << *this << std::endl;
-    NamedValues.clear();
+    Codegen().named_values.clear();
+    Codegen().reassigned_names.clear();
+    bool tail_loop = false;
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        (*iter)->find_reassigned(&Codegen().reassigned_names);
+        tail_loop = tail_loop || (*iter)->returns_call_to(proto->name);
+    }
 
     Function *function = proto->codegen();
     if (function == NULL) {
         return ERROR("Error generating function prototype");
     }
 
-    BasicBlock *bb = BasicBlock::Create(getGlobalContext(), "entry", function);
-    Builder.SetInsertPoint(bb);
-
-    // Set the names of all the arguments
-    unsigned idx = 0;
-    for (auto iter = function->arg_begin(); idx != proto->args.size(); idx++, iter++) {
-        iter->setName(proto->args[idx]);
-        auto ptr = Builder.CreateAlloca(Type::getInt64Ty(getGlobalContext()),
-                                        nullptr, proto->args[idx]);
-        Builder.CreateStore(iter, ptr);
-        NamedValues[proto->args[idx]] = ptr;
-    }
+    BasicBlock *bb = BasicBlock::Create(TheContext(), "entry", function);
+    TheBuilder().SetInsertPoint(bb);
+    arguments_codegen(function, proto->args.begin(), tail_loop);
 
     for (auto iter = body.begin(); iter != body.end(); iter++) {
         bool success = (*iter)->codegen();
@@ -404,16 +380,8 @@ Function *FunctionAST::codegen() {
             return ERROR("Error generating function code");
         }
     }
-    if (proto->name == "main") {
-        Builder.CreateRet(
-            ConstantInt::get(Type::getInt32Ty(getGlobalContext()), 0));
-    } else if (body.back()->type() != RETURN_AST) {
-        Builder.CreateRet(
-            ConstantInt::get(Type::getInt64Ty(getGlobalContext()), 0));
-    }
-
-    // function->dump();
-    verifyFunction(*function);
-
+    finish_function(function, proto->name,
+                    !body.empty() && body.back()->type() == RETURN_AST);
+    if (memoize) memoize_function(function);
     return function;
 }
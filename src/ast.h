@@ -2,6 +2,8 @@
 #ifndef LENS_AST_H_
 #define LENS_AST_H_
 
+#include <cstdint>
+#include <set>
 #include <string>
 #include <vector>
 #include <iostream>
@@ -10,6 +12,9 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
 
+#include "src/arena.h"
+#include "src/symbol.h"
+
 enum AST_TYPES {
     EXPR_AST,
     NUMBER_AST,
@@ -23,8 +28,25 @@ enum AST_TYPES {
     IF_ELSE_AST
 };
 
+// A BinaryExprAST's op is the token of its operator (see src/tokenizer.h),
+// or one of these, which have no syntax and are only made by the compiler
+enum INTERNAL_OPS {
+    // <lhs> << <rhs>, from multiplying by a power of two in src/fold.cpp
+    OP_SHIFT_LEFT = 1024
+};
+// How an operator is printed
+std::string binary_op_name(int op);
+
+// The module the current thread generates code into, see src/codegen.h
 llvm::Module *TheModule();
 
+class BytecodeCompiler;
+class ConstantFolder;
+class FlatModule;
+class Interpreter;
+// A node in a FlatModule, see src/flat_ast.h
+typedef uint32_t NodeRef;
+
 class StatementAST {
     static const int idtype = STATEMENT_AST;
  public:
@@ -35,6 +57,29 @@ class StatementAST {
         return out;
     }
     virtual bool codegen() = 0;
+    // Copies this node and its children into `module`
+    virtual NodeRef flatten(FlatModule *module) const = 0;
+    // Adds the names this statement assigns to with `re`
+    virtual void find_reassigned(std::set<Symbol> *names) const {}
+    // Whether this returns the result of calling `name`, see
+    // return_call_codegen in src/codegen.h
+    virtual bool returns_call_to(Symbol name) const { return false; }
+    // Runs this statement, see src/interpreter.h. Returns true if it
+    // returned from the function.
+    virtual bool interpret(Interpreter *interpreter) const = 0;
+    // Adds this statement's bytecode, see src/bytecode_compiler.h
+    virtual bool lower(BytecodeCompiler *compiler) const = 0;
+    // Replaces the calls in this statement that can be evaluated while
+    // compiling with their results, see src/fold.h. Returns the statement
+    // to put in this one's place.
+    virtual StatementAST *fold(ConstantFolder *folder) = 0;
+    // Adds the names of the functions this statement calls
+    virtual void find_callees(std::set<Symbol> *names) const {}
+    // The same, leaving out `return f(...)`'s f, which return_call_codegen
+    // turns into a jump
+    virtual void find_non_tail_callees(std::set<Symbol> *names) const {
+        find_callees(names);
+    }
     virtual int type() { return StatementAST::idtype; }
 };
 
@@ -47,26 +92,52 @@ class ExprAST : public StatementAST {
         return (res != NULL);
     }
     virtual llvm::Value *expr_codegen() = 0;
+    virtual bool interpret(Interpreter *interpreter) const {
+        evaluate(interpreter);
+        return false;
+    }
+    virtual int64_t evaluate(Interpreter *interpreter) const = 0;
+    virtual bool lower(BytecodeCompiler *compiler) const;
+    // Returns the register holding the value, or -1 if there's an error
+    virtual int32_t lower_expr(BytecodeCompiler *compiler) const = 0;
+    virtual StatementAST *fold(ConstantFolder *folder) {
+        return fold_expr(folder);
+    }
+    virtual ExprAST *fold_expr(ConstantFolder *folder) = 0;
     virtual int type() { return ExprAST::idtype; }
 };
 
 class NumberAST : public ExprAST {
     static const int idtype = NUMBER_AST;
-    double value;
+    // Integer literals keep their exact value, float literals are doubles
+    bool is_integer;
+    int64_t integer_value;
+    double float_value;
  public:
     virtual void print(std::ostream* out) const;
+    explicit NumberAST(int64_t number);
     explicit NumberAST(double number);
+    int64_t value() const { return integer_value; }
     virtual llvm::Value *expr_codegen();
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual int64_t evaluate(Interpreter *interpreter) const;
+    virtual int32_t lower_expr(BytecodeCompiler *compiler) const;
+    virtual ExprAST *fold_expr(ConstantFolder *folder);
     virtual int type() { return NumberAST::idtype; }
 };
 
 class VariableAST : public ExprAST {
     static const int idtype = VARIABLE_AST;
-    std::string name;
+    Symbol name;
  public:
     virtual void print(std::ostream* out) const;
-    explicit VariableAST(std::string str);
+    explicit VariableAST(Symbol name);
+    Symbol symbol() const { return name; }
     virtual llvm::Value *expr_codegen();
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual int64_t evaluate(Interpreter *interpreter) const;
+    virtual int32_t lower_expr(BytecodeCompiler *compiler) const;
+    virtual ExprAST *fold_expr(ConstantFolder *folder);
     virtual int type() { return VariableAST::idtype; }
 };
 
@@ -75,46 +146,78 @@ class BinaryExprAST : public ExprAST {
     static const int idtype = BINARY_EXPR_AST;
     int op;
     ExprAST *lhs, *rhs;
+
+    ExprAST *fold_constant_rhs(ConstantFolder *folder, int64_t value);
  public:
     virtual void print(std::ostream* out) const;
     BinaryExprAST(ExprAST *lhs, int op, ExprAST *rhs);
     virtual llvm::Value *expr_codegen();
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual int64_t evaluate(Interpreter *interpreter) const;
+    virtual int32_t lower_expr(BytecodeCompiler *compiler) const;
+    virtual ExprAST *fold_expr(ConstantFolder *folder);
+    virtual void find_callees(std::set<Symbol> *names) const;
     virtual int type() { return BinaryExprAST::idtype; }
 };
 
 // <ident>(<ident>, ...)
 class CallAST : public ExprAST {
     static const int idtype = CALL_AST;
-    std::string name;
-    std::vector<ExprAST *> args;
+    Symbol name;
+    ArenaArray<ExprAST*> args;
  public:
-    CallAST(std::string name, std::vector<ExprAST*> args);
+    CallAST(Symbol name, ArenaArray<ExprAST*> args);
+    Symbol callee() const { return name; }
     virtual void print(std::ostream* out) const;
     virtual llvm::Value *expr_codegen();
+    // Generates `return <this call>`
+    bool return_codegen();
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual int64_t evaluate(Interpreter *interpreter) const;
+    // Runs `return <this call>`
+    void interpret_return(Interpreter *interpreter) const;
+    virtual int32_t lower_expr(BytecodeCompiler *compiler) const;
+    // Lowers `return <this call>`
+    bool lower_return(BytecodeCompiler *compiler) const;
+    virtual ExprAST *fold_expr(ConstantFolder *folder);
+    virtual void find_callees(std::set<Symbol> *names) const;
+    // Adds the functions called while working out the arguments
+    void find_argument_callees(std::set<Symbol> *names) const;
     virtual int type() { return CallAST::idtype; }
 };
 
 // let <ident> = <expr>
 class AssignmentAST : public StatementAST {
     static const int idtype = ASSIGNMENT_AST;
-    std::string name;
+    Symbol name;
     ExprAST *rhs;
  public:
     virtual void print(std::ostream* out) const;
-    AssignmentAST(std::string name, ExprAST *rhs);
+    AssignmentAST(Symbol name, ExprAST *rhs);
     virtual bool codegen();
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual bool interpret(Interpreter *interpreter) const;
+    virtual bool lower(BytecodeCompiler *compiler) const;
+    virtual StatementAST *fold(ConstantFolder *folder);
+    virtual void find_callees(std::set<Symbol> *names) const;
     virtual int type() { return AssignmentAST::idtype; }
 };
 
 // <ident> = <expr>
 class ReassignAST : public StatementAST {
     static const int idtype = REASSIGN_AST;
-    std::string name;
+    Symbol name;
     ExprAST *rhs;
  public:
     virtual void print(std::ostream* out) const;
-    ReassignAST(std::string name, ExprAST *rhs);
+    ReassignAST(Symbol name, ExprAST *rhs);
     virtual bool codegen();
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual void find_reassigned(std::set<Symbol> *names) const;
+    virtual bool interpret(Interpreter *interpreter) const;
+    virtual bool lower(BytecodeCompiler *compiler) const;
+    virtual StatementAST *fold(ConstantFolder *folder);
+    virtual void find_callees(std::set<Symbol> *names) const;
     virtual int type() { return ReassignAST::idtype; }
 };
 
@@ -126,39 +229,67 @@ class ReturnAST : public StatementAST {
     virtual void print(std::ostream* out) const;
     explicit ReturnAST(ExprAST *rhs);
     virtual bool codegen();
+    virtual bool returns_call_to(Symbol name) const;
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual bool interpret(Interpreter *interpreter) const;
+    virtual bool lower(BytecodeCompiler *compiler) const;
+    virtual StatementAST *fold(ConstantFolder *folder);
+    virtual void find_callees(std::set<Symbol> *names) const;
+    virtual void find_non_tail_callees(std::set<Symbol> *names) const;
     virtual int type() { return ReturnAST::idtype; }
 };
 
 class IfElseAST : public StatementAST {
     static const int idtype = IF_ELSE_AST;
     ExprAST *condition;
-    std::vector<StatementAST*> ifbody;
-    std::vector<StatementAST*> elsebody;
+    ArenaArray<StatementAST*> ifbody;
+    ArenaArray<StatementAST*> elsebody;
  public:
     IfElseAST(ExprAST *cond,
-              std::vector<StatementAST*> ifbody,
-              std::vector<StatementAST*> elsebody);
+              ArenaArray<StatementAST*> ifbody,
+              ArenaArray<StatementAST*> elsebody);
     virtual void print(std::ostream* out) const;
     virtual bool codegen();
+    virtual NodeRef flatten(FlatModule *module) const;
+    virtual void find_reassigned(std::set<Symbol> *names) const;
+    virtual bool returns_call_to(Symbol name) const;
+    virtual bool interpret(Interpreter *interpreter) const;
+    virtual bool lower(BytecodeCompiler *compiler) const;
+    virtual StatementAST *fold(ConstantFolder *folder);
+    virtual void find_callees(std::set<Symbol> *names) const;
+    virtual void find_non_tail_callees(std::set<Symbol> *names) const;
     virtual int type() { return IfElseAST::idtype; }
 };
 
 class PrototypeAST {
  public:
-    std::string name;
-    std::vector<std::string> args;
-    PrototypeAST(std::string name, std::vector<std::string> args);
+    Symbol name;
+    ArenaArray<Symbol> args;
+    PrototypeAST(Symbol name, ArenaArray<Symbol> args);
     friend std::ostream& operator<<(std::ostream& out, PrototypeAST const& ast);
     llvm::Function *codegen();
 };
 
 class FunctionAST {
     PrototypeAST *proto;
-    std::vector<StatementAST*> body;
+    ArenaArray<StatementAST*> body;
+    // Generate it with a memo table, see memoize_function in src/codegen.h
+    bool memoize;
  public:
-    FunctionAST(PrototypeAST *proto, std::vector<StatementAST*> body);
+    FunctionAST(PrototypeAST *proto, ArenaArray<StatementAST*> body);
+    Symbol name() const { return proto->name; }
+    bool memoized() const { return memoize; }
+    void set_memoized(bool memoized) { memoize = memoized; }
+    size_t arg_count() const { return proto->args.size(); }
+    const ArenaArray<Symbol> &params() const { return proto->args; }
+    const ArenaArray<StatementAST*> &statements() const { return body; }
     friend std::ostream& operator<<(std::ostream& out, FunctionAST const& ast);
     llvm::Function *codegen();
+    // Copies the function into `module`, returning its index there
+    uint32_t flatten(FlatModule *module) const;
+    void fold(ConstantFolder *folder);
+    void find_callees(std::set<Symbol> *names) const;
+    void find_non_tail_callees(std::set<Symbol> *names) const;
 };
 
 #endif  // LENS_AST_H_
@@ -0,0 +1,88 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/ast_bench.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+#include <vector>
+
+#include "src/ast.h"
+#include "src/codegen.h"
+#include "src/flat_ast.h"
+#include "src/timer.h"
+
+using namespace llvm;
+
+// Deletes every function after the first `keep` in the module, so the same
+// names can be generated again
+static void erase_functions(Module *module, size_t keep) {
+    std::vector<Function*> generated;
+    size_t index = 0;
+    for (auto iter = module->begin(); iter != module->end(); iter++, index++) {
+        if (index >= keep) generated.push_back(&*iter);
+    }
+    // The functions call each other, so they all have to let go of each
+    // other before any of them can be deleted
+    for (auto iter = generated.begin(); iter != generated.end(); iter++) {
+        (*iter)->dropAllReferences();
+    }
+    for (auto iter = generated.begin(); iter != generated.end(); iter++) {
+        (*iter)->eraseFromParent();
+    }
+    TheBuilder().ClearInsertionPoint();
+}
+
+void bench_ast(const std::vector<FunctionAST*> &functions) {
+    Module *module = TheModule();
+    // Keep the prelude
+    size_t keep = module->getFunctionList().size();
+
+    double flatten_time = 1e300;
+    FlatModule flat;
+    for (int round = 0; round < kBenchRounds; round++) {
+        flat = FlatModule();
+        Timer timer;
+        for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+            (*iter)->flatten(&flat);
+        }
+        flatten_time = std::min(flatten_time, timer.milliseconds());
+    }
+
+    double tree_print = 1e300, flat_print = 1e300;
+    double tree_codegen = 1e300, flat_codegen = 1e300;
+    for (int round = 0; round < kBenchRounds; round++) {
+        std::ostringstream tree_out, flat_out;
+        Timer timer;
+        for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+            tree_out << **iter;
+        }
+        tree_print = std::min(tree_print, timer.milliseconds());
+
+        timer.restart();
+        for (uint32_t i = 0; i < flat.functions.size(); i++) {
+            flat.print_function(&flat_out, i);
+        }
+        flat_print = std::min(flat_print, timer.milliseconds());
+
+        timer.restart();
+        for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+            (*iter)->codegen();
+        }
+        tree_codegen = std::min(tree_codegen, timer.milliseconds());
+        erase_functions(module, keep);
+
+        timer.restart();
+        for (uint32_t i = 0; i < flat.functions.size(); i++) {
+            flat.function_codegen(i);
+        }
+        flat_codegen = std::min(flat_codegen, timer.milliseconds());
+        erase_functions(module, keep);
+    }
+
+    printf("%zu functions, best of %d runs\n", functions.size(), kBenchRounds);
+    printf("flatten          %10.3f ms\n", flatten_time);
+    printf("print    tree    %10.3f ms\n", tree_print);
+    printf("         flat    %10.3f ms\n", flat_print);
+    printf("codegen  tree    %10.3f ms\n", tree_codegen);
+    printf("         flat    %10.3f ms\n", flat_codegen);
+}
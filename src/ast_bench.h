@@ -0,0 +1,13 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_AST_BENCH_H_
+#define LENS_AST_BENCH_H_
+
+#include <vector>
+
+class FunctionAST;
+
+// Generates code for `functions` a few times with each AST representation,
+// throwing the code away every time, and prints how long each one took
+void bench_ast(const std::vector<FunctionAST*> &functions);
+
+#endif  // LENS_AST_BENCH_H_
@@ -0,0 +1,236 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/bytecode.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// File layout, all integers little endian:
+//   "LBC1"
+//   u32 function count, i32 main
+//   for each function:
+//     u32 name length, the name
+//     u16 param count, u32 register count
+//     u32 constant count, i64 constants
+//     u32 instruction count, 4 x u16 per instruction
+static const char kMagic[4] = {'L', 'B', 'C', '1'};
+
+static void put(std::vector<uint8_t> *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out->push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+bool write_bytecode(const BytecodeProgram &program,
+                    const std::string &filename) {
+    std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+    put(&out, program.functions.size(), 4);
+    put(&out, static_cast<uint32_t>(program.main), 4);
+    for (auto function = program.functions.begin();
+         function != program.functions.end(); function++) {
+        put(&out, function->name.size(), 4);
+        out.insert(out.end(), function->name.begin(), function->name.end());
+        put(&out, function->param_count, 2);
+        put(&out, function->register_count, 4);
+        put(&out, function->constants.size(), 4);
+        for (auto constant = function->constants.begin();
+             constant != function->constants.end(); constant++) {
+            put(&out, static_cast<uint64_t>(*constant), 8);
+        }
+        put(&out, function->code.size(), 4);
+        for (auto instruction = function->code.begin();
+             instruction != function->code.end(); instruction++) {
+            put(&out, instruction->op, 2);
+            put(&out, instruction->a, 2);
+            put(&out, instruction->b, 2);
+            put(&out, instruction->c, 2);
+        }
+    }
+
+    FILE *file = fopen(filename.c_str(), "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Couldn't open '%s' for writing\n", filename.c_str());
+        return false;
+    }
+    bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+    written = fclose(file) == 0 && written;
+    if (!written) fprintf(stderr, "Couldn't write '%s'\n", filename.c_str());
+    return written;
+}
+
+// Reads little endian integers out of a file's bytes, remembering if it
+// ever ran past the end
+class ByteReader {
+    const std::vector<uint8_t> &bytes;
+    size_t offset;
+
+ public:
+    bool overrun;
+    explicit ByteReader(const std::vector<uint8_t> &bytes)
+        : bytes(bytes), offset(0), overrun(false) {}
+    uint64_t get(int size) {
+        if (bytes.size() - offset < static_cast<size_t>(size)) {
+            overrun = true;
+            offset = bytes.size();
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < size; i++) {
+            value |= static_cast<uint64_t>(bytes[offset++]) << (8 * i);
+        }
+        return value;
+    }
+    // Whether `count` more items of `size` bytes could be in the file, so a
+    // bad count can't make us allocate too much
+    bool has(uint64_t count, int size) const {
+        return count <= (bytes.size() - offset) / size;
+    }
+    std::string get_string(size_t length) {
+        if (!has(length, 1)) {
+            overrun = true;
+            return "";
+        }
+        std::string text(bytes.begin() + offset,
+                         bytes.begin() + offset + length);
+        offset += length;
+        return text;
+    }
+};
+
+bool read_bytecode(const std::string &filename, BytecodeProgram *program) {
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Couldn't open '%s'\n", filename.c_str());
+        return false;
+    }
+    std::vector<uint8_t> bytes;
+    uint8_t buffer[1 << 16];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    fclose(file);
+
+    if (bytes.size() < sizeof(kMagic) ||
+        memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0) {
+        fprintf(stderr, "'%s' isn't Lens bytecode\n", filename.c_str());
+        return false;
+    }
+    ByteReader in(bytes);
+    in.get_string(sizeof(kMagic));
+    uint32_t function_count = in.get(4);
+    program->main = static_cast<int32_t>(in.get(4));
+    program->functions.clear();
+    for (uint32_t i = 0; i < function_count && !in.overrun; i++) {
+        BytecodeFunction function;
+        function.name = in.get_string(in.get(4));
+        function.param_count = in.get(2);
+        function.register_count = in.get(4);
+        uint32_t constant_count = in.get(4);
+        if (!in.has(constant_count, 8)) break;
+        for (uint32_t j = 0; j < constant_count; j++) {
+            function.constants.push_back(static_cast<int64_t>(in.get(8)));
+        }
+        uint32_t instruction_count = in.get(4);
+        if (!in.has(instruction_count, 8)) break;
+        for (uint32_t j = 0; j < instruction_count; j++) {
+            Instruction instruction;
+            instruction.op = in.get(2);
+            instruction.a = in.get(2);
+            instruction.b = in.get(2);
+            instruction.c = in.get(2);
+            function.code.push_back(instruction);
+        }
+        program->functions.push_back(function);
+    }
+    if (in.overrun || program->functions.size() != function_count) {
+        fprintf(stderr, "'%s' is cut short\n", filename.c_str());
+        return false;
+    }
+    return verify_bytecode(*program);
+}
+
+// Checks one function, printing the first problem
+static bool verify_function(const BytecodeProgram &program,
+                            const BytecodeFunction &function) {
+    const char *problem = NULL;
+    uint32_t registers = function.register_count;
+    if (registers > kMaxRegisters || function.param_count > registers) {
+        problem = "has too many registers";
+    }
+    // Every path has to end in a return or a jump, so running off the end
+    // means falling through the last instruction
+    if (function.code.empty() ||
+        (function.code.back().op != OP_RETURN &&
+         function.code.back().op != OP_JUMP)) {
+        problem = "doesn't end in a return";
+    }
+    for (size_t i = 0; i < function.code.size() && problem == NULL; i++) {
+        const Instruction &in = function.code[i];
+        switch (in.op) {
+        case OP_LOADI:
+            if (in.a >= registers) problem = "uses a missing register";
+            break;
+        case OP_LOADK:
+            if (in.a >= registers) problem = "uses a missing register";
+            if (wide_operand(in) >= function.constants.size()) {
+                problem = "uses a missing constant";
+            }
+            break;
+        case OP_MOVE:
+            if (in.a >= registers || in.b >= registers) {
+                problem = "uses a missing register";
+            }
+            break;
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+        case OP_LT: case OP_GT: case OP_EQ: case OP_NE: case OP_SHL:
+            if (in.a >= registers || in.b >= registers || in.c >= registers) {
+                problem = "uses a missing register";
+            }
+            break;
+        case OP_JUMP_IF_ZERO:
+            if (in.a >= registers) problem = "uses a missing register";
+            // Fall through
+        case OP_JUMP:
+            if (wide_operand(in) >= function.code.size()) {
+                problem = "jumps out of the function";
+            }
+            break;
+        case OP_CALL:
+            if (in.b >= program.functions.size()) {
+                problem = "calls a missing function";
+            } else if (in.a >= registers || static_cast<uint32_t>(in.c) +
+                       program.functions[in.b].param_count > registers) {
+                problem = "uses a missing register";
+            }
+            break;
+        case OP_PRINT:
+        case OP_RETURN:
+            if (in.a >= registers) problem = "uses a missing register";
+            break;
+        default:
+            problem = "has an unknown instruction";
+        }
+    }
+    if (problem != NULL) {
+        fprintf(stderr, "Bad bytecode: %s %s\n", function.name.c_str(),
+                problem);
+        return false;
+    }
+    return true;
+}
+
+bool verify_bytecode(const BytecodeProgram &program) {
+    if (program.functions.size() > kMaxFunctions ||
+        program.main >= static_cast<int64_t>(program.functions.size()) ||
+        program.main < -1) {
+        fprintf(stderr, "Bad bytecode: no such main function\n");
+        return false;
+    }
+    for (auto function = program.functions.begin();
+         function != program.functions.end(); function++) {
+        if (!verify_function(program, *function)) return false;
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_BYTECODE_H_
+#define LENS_BYTECODE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A register based bytecode for running Lens without LLVM. It's compiled
+// from the AST by src/bytecode_compiler.h, run by src/vm.h, and can be
+// written to a file and read back in, so lensvm can run programs without
+// compiling them. Nothing here depends on LLVM.
+//
+// Every instruction is 8 bytes: an opcode and three 16 bit operands. A, B
+// and C are registers unless the opcode says otherwise. Where an operand is
+// 32 bits (a constant or a jump target) it's B << 16 | C.
+enum OPCODES {
+    // A = the 32 bit signed value B << 16 | C
+    OP_LOADI,
+    // A = constants[B << 16 | C]
+    OP_LOADK,
+    // A = B
+    OP_MOVE,
+    // A = B <op> C. Arithmetic wraps around, comparisons give 0 or 1.
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_LT,
+    OP_GT,
+    OP_EQ,
+    OP_NE,
+    // Go to instruction B << 16 | C
+    OP_JUMP,
+    // Go to instruction B << 16 | C if A is 0
+    OP_JUMP_IF_ZERO,
+    // A = functions[B](C, C + 1, ...). The arguments are the first registers
+    // of the callee's frame, which starts at C.
+    OP_CALL,
+    // printi64(A)
+    OP_PRINT,
+    // Return A
+    OP_RETURN,
+    // A = B << C
+    OP_SHL,
+    NUM_OPCODES
+};
+
+struct Instruction {
+    uint16_t op;
+    uint16_t a, b, c;
+};
+
+inline uint32_t wide_operand(const Instruction &instruction) {
+    return static_cast<uint32_t>(instruction.b) << 16 | instruction.c;
+}
+
+// The largest register, function or instruction index that fits
+static const uint32_t kMaxRegisters = UINT16_MAX + 1;
+static const uint32_t kMaxFunctions = UINT16_MAX + 1;
+
+struct BytecodeFunction {
+    std::string name;
+    uint16_t param_count;
+    // The size of the function's frame. Its params are registers
+    // [0, param_count).
+    uint32_t register_count;
+    std::vector<int64_t> constants;
+    std::vector<Instruction> code;
+};
+
+struct BytecodeProgram {
+    std::vector<BytecodeFunction> functions;
+    // The index of main, or -1 if there's no top level code
+    int32_t main;
+};
+
+// Both print what went wrong and return false on failure. read_bytecode
+// checks every operand is in range, so the VM can trust the program.
+bool write_bytecode(const BytecodeProgram &program,
+                    const std::string &filename);
+bool read_bytecode(const std::string &filename, BytecodeProgram *program);
+// Checks the operands of every instruction are in range
+bool verify_bytecode(const BytecodeProgram &program);
+
+#endif  // LENS_BYTECODE_H_
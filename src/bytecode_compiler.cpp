@@ -0,0 +1,347 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/bytecode_compiler.h"
+
+#include <cstdio>
+#include <map>
+#include <vector>
+
+#include "src/tokenizer.h"
+
+#define ERROR(msg, ...) (printf("Bytecode error: " msg "\n", \
+##__VA_ARGS__), -1)
+#define ERRORB(msg, ...) (printf("Bytecode error: " msg "\n", \
+##__VA_ARGS__), false)
+
+// ========================================================================= //
+// Expressions
+// ========================================================================= //
+bool ExprAST::lower(BytecodeCompiler *compiler) const {
+    uint32_t mark = compiler->register_mark();
+    bool lowered = lower_expr(compiler) >= 0;
+    compiler->free_registers(mark);
+    return lowered;
+}
+
+int32_t NumberAST::lower_expr(BytecodeCompiler *compiler) const {
+    int32_t reg = compiler->allocate_register();
+    if (reg < 0) return -1;
+    compiler->emit_load(reg, integer_value);
+    return reg;
+}
+
+int32_t VariableAST::lower_expr(BytecodeCompiler *compiler) const {
+    return compiler->variable(name);
+}
+
+static int binary_opcode(int op) {
+    switch (op) {
+    case '+': return OP_ADD;
+    case '-': return OP_SUB;
+    case '*': return OP_MUL;
+    case '/': return OP_DIV;
+    case '<': return OP_LT;
+    case '>': return OP_GT;
+    case tokEq: return OP_EQ;
+    case tokIneq: return OP_NE;
+    case OP_SHIFT_LEFT: return OP_SHL;
+    default: return -1;
+    }
+}
+
+int32_t BinaryExprAST::lower_expr(BytecodeCompiler *compiler) const {
+    int opcode = binary_opcode(op);
+    if (opcode < 0) return ERROR("invalid binary operator");
+    uint32_t mark = compiler->register_mark();
+    int32_t L = lhs->lower_expr(compiler);
+    if (L < 0) return -1;
+    int32_t R = rhs->lower_expr(compiler);
+    if (R < 0) return -1;
+    // Both operands are read before the result is written, so the result
+    // can go in one of their registers
+    compiler->free_registers(mark);
+    int32_t result = compiler->allocate_register();
+    if (result < 0) return -1;
+    compiler->emit(opcode, result, L, R);
+    return result;
+}
+
+int32_t CallAST::lower_expr(BytecodeCompiler *compiler) const {
+    if (name == SYM_PRINTI64 && !compiler->defines(name) &&
+        args.size() == 1) {
+        int32_t value = args[0]->lower_expr(compiler);
+        if (value < 0) return -1;
+        compiler->emit(OP_PRINT, value, 0, 0);
+        return value;
+    }
+    int32_t function = compiler->callee(name, args.size());
+    if (function < 0) return -1;
+
+    // The arguments go in a row of registers, which becomes the start of
+    // the callee's frame. Each one is lowered with the registers after its
+    // place free, so a temporary result lands right there. The result of
+    // the call goes in the first one.
+    int32_t base = compiler->register_mark();
+    for (size_t i = 0; i < args.size(); i++) {
+        compiler->free_registers(base + i);
+        int32_t value = args[i]->lower_expr(compiler);
+        if (value < 0) return -1;
+        compiler->free_registers(base + i);
+        int32_t reg = compiler->allocate_register();
+        if (reg < 0) return -1;
+        if (reg != value) compiler->emit(OP_MOVE, reg, value, 0);
+    }
+    compiler->free_registers(base);
+    if (compiler->allocate_register() < 0) return -1;
+    compiler->emit(OP_CALL, base, function, base);
+    compiler->free_registers(base + 1);
+    return base;
+}
+
+bool CallAST::lower_return(BytecodeCompiler *compiler) const {
+    uint32_t mark = compiler->register_mark();
+    if (name != compiler->function_name()) {
+        int32_t value = lower_expr(compiler);
+        if (value < 0) return false;
+        compiler->emit(OP_RETURN, value, 0, 0);
+        compiler->free_registers(mark);
+        return true;
+    }
+    if (compiler->callee(name, args.size()) < 0) return false;
+
+    // A call to the function being compiled is a loop, like in the native
+    // code, so it runs in constant stack. Every argument is worked out
+    // before any param is overwritten, since they can read the params.
+    for (size_t i = 0; i < args.size(); i++) {
+        compiler->free_registers(mark + i);
+        int32_t value = args[i]->lower_expr(compiler);
+        if (value < 0) return false;
+        compiler->free_registers(mark + i);
+        int32_t reg = compiler->allocate_register();
+        if (reg < 0) return false;
+        if (reg != value) compiler->emit(OP_MOVE, reg, value, 0);
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+        compiler->emit(OP_MOVE, i, mark + i, 0);
+    }
+    compiler->emit_wide(OP_JUMP, 0, 0);
+    compiler->free_registers(mark);
+    return true;
+}
+
+// ========================================================================= //
+// Statements
+// ========================================================================= //
+bool AssignmentAST::lower(BytecodeCompiler *compiler) const {
+    uint32_t mark = compiler->register_mark();
+    int32_t value = rhs->lower_expr(compiler);
+    if (value < 0) return false;
+    // The variable gets the first free register, which is where the value
+    // is unless it came from another variable
+    compiler->free_registers(mark);
+    int32_t reg = compiler->allocate_register();
+    if (reg < 0) return false;
+    if (reg != value) compiler->emit(OP_MOVE, reg, value, 0);
+    compiler->bind(name, reg);
+    return true;
+}
+
+bool ReassignAST::lower(BytecodeCompiler *compiler) const {
+    int32_t reg = compiler->variable(name);
+    if (reg < 0) return false;
+    uint32_t mark = compiler->register_mark();
+    int32_t value = rhs->lower_expr(compiler);
+    if (value < 0) return false;
+    if (reg != value) compiler->emit(OP_MOVE, reg, value, 0);
+    compiler->free_registers(mark);
+    return true;
+}
+
+bool ReturnAST::lower(BytecodeCompiler *compiler) const {
+    if (rvalue->type() == CALL_AST) {
+        return static_cast<CallAST*>(rvalue)->lower_return(compiler);
+    }
+    uint32_t mark = compiler->register_mark();
+    int32_t value = rvalue->lower_expr(compiler);
+    if (value < 0) return false;
+    compiler->emit(OP_RETURN, value, 0, 0);
+    compiler->free_registers(mark);
+    return true;
+}
+
+static bool ends_with_return(const ArenaArray<StatementAST*> &body) {
+    return !body.empty() && body.back()->type() == RETURN_AST;
+}
+
+// Lowers a branch of an if, in a scope of its own
+static bool lower_branch(const ArenaArray<StatementAST*> &body,
+                         BytecodeCompiler *compiler) {
+    std::map<Symbol, uint16_t> outer_scope = compiler->scope();
+    uint32_t mark = compiler->register_mark();
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        if (!(*iter)->lower(compiler)) return false;
+    }
+    compiler->restore_scope(outer_scope);
+    compiler->free_registers(mark);
+    return true;
+}
+
+bool IfElseAST::lower(BytecodeCompiler *compiler) const {
+    uint32_t mark = compiler->register_mark();
+    int32_t condval = condition->lower_expr(compiler);
+    if (condval < 0) {
+        return ERRORB("failed generating condition for if");
+    }
+    size_t to_else = compiler->emit_wide(OP_JUMP_IF_ZERO, condval, 0);
+    compiler->free_registers(mark);
+
+    if (!lower_branch(ifbody, compiler)) {
+        return ERRORB("failed generating statement in if");
+    }
+    size_t to_end = 0;
+    bool if_returns = ends_with_return(ifbody);
+    if (!if_returns) to_end = compiler->emit_wide(OP_JUMP, 0, 0);
+
+    compiler->patch_jump(to_else);
+    if (!lower_branch(elsebody, compiler)) {
+        return ERRORB("failed generating statement in if");
+    }
+    if (!if_returns) compiler->patch_jump(to_end);
+    return true;
+}
+
+// ========================================================================= //
+// Compiler
+// ========================================================================= //
+BytecodeCompiler::BytecodeCompiler(BytecodeProgram *program)
+    : program(program), function(NULL), name(), next_register(0) {}
+
+int32_t BytecodeCompiler::allocate_register() {
+    if (next_register == kMaxRegisters) {
+        return ERROR("%s uses too many registers", function->name.c_str());
+    }
+    int32_t reg = next_register++;
+    if (next_register > function->register_count) {
+        function->register_count = next_register;
+    }
+    return reg;
+}
+
+int32_t BytecodeCompiler::variable(Symbol name) {
+    auto variable = variables.find(name);
+    if (variable == variables.end()) {
+        return ERROR("Unknown variable name '%s'",
+                     Symbols().name(name).c_str());
+    }
+    return variable->second;
+}
+
+size_t BytecodeCompiler::emit(int op, uint16_t a, uint16_t b, uint16_t c) {
+    Instruction instruction = {static_cast<uint16_t>(op), a, b, c};
+    function->code.push_back(instruction);
+    return function->code.size() - 1;
+}
+
+size_t BytecodeCompiler::emit_wide(int op, uint16_t a, uint32_t operand) {
+    return emit(op, a, operand >> 16, operand & 0xffff);
+}
+
+void BytecodeCompiler::patch_jump(size_t jump) {
+    uint32_t target = function->code.size();
+    function->code[jump].b = target >> 16;
+    function->code[jump].c = target & 0xffff;
+}
+
+void BytecodeCompiler::emit_load(uint16_t reg, int64_t value) {
+    if (value == static_cast<int32_t>(value)) {
+        emit_wide(OP_LOADI, reg, static_cast<uint32_t>(value));
+        return;
+    }
+    auto constant = constant_indices.find(value);
+    if (constant == constant_indices.end()) {
+        constant = constant_indices.insert(
+            std::make_pair(value, function->constants.size())).first;
+        function->constants.push_back(value);
+    }
+    emit_wide(OP_LOADK, reg, constant->second);
+}
+
+int32_t BytecodeCompiler::callee(Symbol name, size_t arg_count) {
+    const std::string &callee_name = Symbols().name(name);
+    auto index = indices.find(name);
+    if (index == indices.end()) {
+        return ERROR("unknown function '%s' referenced", callee_name.c_str());
+    }
+    size_t expected = program->functions[index->second].param_count;
+    if (expected != arg_count) {
+        return ERROR("incorrect number of arguments "
+                     "(%s expected %li, %li given)",
+                     callee_name.c_str(), expected, arg_count);
+    }
+    return index->second;
+}
+
+bool BytecodeCompiler::compile_function(const FunctionAST &ast) {
+    name = ast.name();
+    variables.clear();
+    constant_indices.clear();
+    next_register = 0;
+    const ArenaArray<Symbol> &params = ast.params();
+    for (auto iter = params.begin(); iter != params.end(); iter++) {
+        int32_t reg = allocate_register();
+        if (reg < 0) return false;
+        bind(*iter, reg);
+    }
+
+    const ArenaArray<StatementAST*> &body = ast.statements();
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        if (!(*iter)->lower(this)) {
+            return ERRORB("Error generating function code");
+        }
+    }
+    // Falling off the end returns 0
+    if (ast.name() == SYM_MAIN || !ends_with_return(body)) {
+        int32_t reg = allocate_register();
+        if (reg < 0) return false;
+        emit_load(reg, 0);
+        emit(OP_RETURN, reg, 0, 0);
+    }
+    return true;
+}
+
+bool BytecodeCompiler::compile(const std::vector<FunctionAST*> &functions) {
+    if (functions.size() > kMaxFunctions) {
+        return ERRORB("too many functions");
+    }
+    // Every function is known before any are compiled, so they can call
+    // ones defined after them
+    program->functions.resize(functions.size());
+    program->main = -1;
+    for (size_t i = 0; i < functions.size(); i++) {
+        Symbol name = functions[i]->name();
+        if (!indices.insert(std::make_pair(name, i)).second) {
+            return ERRORB("redifinition of a function");
+        }
+        if (functions[i]->arg_count() > UINT16_MAX) {
+            return ERRORB("%s has too many parameters",
+                          Symbols().name(name).c_str());
+        }
+        if (name == SYM_MAIN) program->main = i;
+        program->functions[i].name = Symbols().name(name);
+        program->functions[i].param_count = functions[i]->arg_count();
+        program->functions[i].register_count = 0;
+    }
+
+    bool compiled = true;
+    for (size_t i = 0; i < functions.size(); i++) {
+        function = &program->functions[i];
+        if (!compile_function(*functions[i])) compiled = false;
+    }
+    function = NULL;
+    return compiled;
+}
+
+bool compile_bytecode(const std::vector<FunctionAST*> &functions,
+                      BytecodeProgram *program) {
+    BytecodeCompiler compiler(program);
+    return compiler.compile(functions);
+}
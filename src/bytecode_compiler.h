@@ -0,0 +1,73 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_BYTECODE_COMPILER_H_
+#define LENS_BYTECODE_COMPILER_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "src/ast.h"
+#include "src/bytecode.h"
+#include "src/symbol.h"
+
+// Lowers FunctionASTs to bytecode. The statements and expressions lower
+// themselves, using the compiler to emit instructions and keep track of
+// registers.
+//
+// Registers are handed out like a stack. Variables keep theirs until they
+// go out of scope, and everything above register_mark() is a temporary
+// that's free again after free_registers(). A variable's value is used
+// straight from its register, since expressions can't change variables.
+class BytecodeCompiler {
+    BytecodeProgram *program;
+    // The index of each function, by name
+    std::map<Symbol, uint32_t> indices;
+    // What's being compiled
+    BytecodeFunction *function;
+    Symbol name;
+    std::map<Symbol, uint16_t> variables;
+    std::map<int64_t, uint32_t> constant_indices;
+    uint32_t next_register;
+
+    bool compile_function(const FunctionAST &ast);
+
+ public:
+    explicit BytecodeCompiler(BytecodeProgram *program);
+    // Compiles all of `functions` into the program
+    bool compile(const std::vector<FunctionAST*> &functions);
+
+    // The name of the function being compiled
+    Symbol function_name() const { return name; }
+
+    // Returns a free register, or -1 if the function has run out
+    int32_t allocate_register();
+    uint32_t register_mark() const { return next_register; }
+    void free_registers(uint32_t mark) { next_register = mark; }
+
+    // The register of a variable in scope, or -1 after printing an error
+    int32_t variable(Symbol name);
+    void bind(Symbol name, uint16_t reg) { variables[name] = reg; }
+    // Branches save the variables in scope, and put them back after
+    std::map<Symbol, uint16_t> scope() const { return variables; }
+    void restore_scope(const std::map<Symbol, uint16_t> &saved) {
+        variables = saved;
+    }
+
+    // Returns the index of the instruction
+    size_t emit(int op, uint16_t a, uint16_t b, uint16_t c);
+    size_t emit_wide(int op, uint16_t a, uint32_t operand);
+    // Points the jump at `jump` to the next instruction emitted
+    void patch_jump(size_t jump);
+    // reg = value
+    void emit_load(uint16_t reg, int64_t value);
+    bool defines(Symbol name) const { return indices.count(name) != 0; }
+    // The index of the function called `name`, checking the argument count,
+    // or -1 after printing an error
+    int32_t callee(Symbol name, size_t arg_count);
+};
+
+// Compiles `functions` into `program`. Errors are printed as they're found.
+bool compile_bytecode(const std::vector<FunctionAST*> &functions,
+                      BytecodeProgram *program);
+
+#endif  // LENS_BYTECODE_COMPILER_H_
@@ -0,0 +1,404 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/codegen.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "src/ast.h"
+#include "src/tokenizer.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Analysis/Verifier.h"
+
+#define ERROR(msg, ...) (printf("Code generation error: " msg "\n", \
+##__VA_ARGS__), nullptr)
+
+using namespace llvm;
+
+CodegenContext::CodegenContext(LLVMContext *context, Module *module)
+    : context(context), module(module), builder(*context), signatures(NULL),
+      call_through_slots(false), readnone(NULL), tail_loop(NULL) {}
+
+static thread_local CodegenContext *current_context = NULL;
+
+static CodegenContext *create_main_context() {
+    LLVMContext *context = &getGlobalContext();
+    CodegenContext *main_context =
+        new CodegenContext(context, new Module("Whatever", *context));
+    // The prelude is generated with it
+    current_context = main_context;
+    generate_prelude(main_context->module);
+    return main_context;
+}
+
+CodegenContext &Codegen() {
+    if (current_context == NULL) {
+        static CodegenContext *main_context = create_main_context();
+        current_context = main_context;
+    }
+    return *current_context;
+}
+
+CodegenContext *set_codegen_context(CodegenContext *context) {
+    CodegenContext *previous = current_context;
+    current_context = context;
+    return previous;
+}
+
+LLVMContext &TheContext() { return *Codegen().context; }
+IRBuilder<> &TheBuilder() { return Codegen().builder; }
+Module *TheModule() { return Codegen().module; }
+
+void declare_prelude(Module *module) {
+    // "C" printf(fmt: ^str, args...) -> void
+    std::vector<Type*> printf_args = {TheBuilder().getInt8Ty()->getPointerTo()};
+    FunctionType *printf_type =
+        FunctionType::get(TheBuilder().getInt32Ty(), printf_args, true);
+    module->getOrInsertFunction("printf", printf_type);
+
+    // printi64(n: i64) -> void
+    std::vector<Type*> v = {Type::getInt64Ty(TheContext())};
+    FunctionType *printi64_type = FunctionType::get(
+        Type::getVoidTy(TheContext()),
+        v,
+        false);
+    module->getOrInsertFunction("printi64", printi64_type);
+
+    module->getFunction("printf")->setDoesNotThrow();
+    module->getFunction("printi64")->setDoesNotThrow();
+}
+
+void generate_prelude(Module *module) {
+    declare_prelude(module);
+    Function *printf_func = module->getFunction("printf");
+    Function *printi64 = module->getFunction("printi64");
+    printi64->arg_begin()->setName("n");
+    BasicBlock *bb = BasicBlock::Create(TheContext(), "entry", printi64);
+    TheBuilder().SetInsertPoint(bb);
+    Value *fmtstr = TheBuilder().CreateGlobalStringPtr("%li\n");
+    TheBuilder().CreateCall2(printf_func, fmtstr, printi64->arg_begin());
+    TheBuilder().CreateRetVoid();
+}
+
+FunctionType *function_type(Symbol name, size_t arg_count) {
+    // Currently just (i64, i64, ...) -> i64
+    std::vector<Type*> ints(arg_count,
+                            Type::getInt64Ty(TheContext()));
+    auto ret_type = Type::getInt64Ty(TheContext());
+    if (name == SYM_MAIN) {
+        ret_type = Type::getInt32Ty(TheContext());
+    }
+    return FunctionType::get(
+        ret_type,
+        ints,
+        false);
+}
+
+std::string slot_name(Symbol name) {
+    return Symbols().name(name) + ".slot";
+}
+
+Function *declare_function(Symbol name, size_t arg_count) {
+    FunctionType *ftype = function_type(name, arg_count);
+    const std::string &function_name = Symbols().name(name);
+    // A call may have declared it already
+    Function *f = TheModule()->getFunction(function_name);
+    if (f != NULL) {
+        if (!f->empty() || f->getFunctionType() != ftype) {
+            return ERROR("redifinition of a function");
+        }
+        return f;
+    }
+    f = Function::Create(ftype,
+                         Function::ExternalLinkage,
+                         function_name,
+                         TheModule());
+    // Lens has no exceptions
+    f->setDoesNotThrow();
+    const std::set<Symbol> *readnone = Codegen().readnone;
+    if (readnone != NULL && readnone->count(name) != 0) {
+        f->setDoesNotAccessMemory();
+    }
+    return f;
+}
+
+void arguments_codegen(Function *function, const Symbol *names,
+                       bool tail_loop) {
+    CodegenContext &codegen = Codegen();
+    codegen.tail_loop = NULL;
+    codegen.tail_params.clear();
+    if (tail_loop) {
+        BasicBlock *entry = TheBuilder().GetInsertBlock();
+        codegen.tail_loop = BasicBlock::Create(TheContext(), "tailrecurse",
+                                               function);
+        TheBuilder().CreateBr(codegen.tail_loop);
+        TheBuilder().SetInsertPoint(codegen.tail_loop);
+        // The phis all have to come before the stores of the arguments
+        // that are reassigned
+        for (auto iter = function->arg_begin(); iter != function->arg_end();
+             iter++) {
+            PHINode *phi = TheBuilder().CreatePHI(
+                Type::getInt64Ty(TheContext()), 2);
+            phi->addIncoming(iter, entry);
+            codegen.tail_params.push_back(phi);
+        }
+    }
+    unsigned idx = 0;
+    for (auto iter = function->arg_begin(); iter != function->arg_end();
+         idx++, iter++) {
+        iter->setName(Symbols().name(names[idx]));
+        if (tail_loop) {
+            codegen.tail_params[idx]->setName(Symbols().name(names[idx]));
+            bind_variable(names[idx], codegen.tail_params[idx]);
+        } else {
+            bind_variable(names[idx], iter);
+        }
+    }
+}
+
+// Allocas have to be in the entry block for mem2reg to promote them, and so
+// that a slot made inside a loop isn't made again on every iteration
+static AllocaInst *create_entry_alloca(Function *function, Symbol name) {
+    BasicBlock &entry = function->getEntryBlock();
+    IRBuilder<> entry_builder(&entry, entry.begin());
+    return entry_builder.CreateAlloca(Type::getInt64Ty(TheContext()),
+                                      nullptr, Symbols().name(name));
+}
+
+void bind_variable(Symbol name, Value *value) {
+    Variable variable = {value, NULL};
+    if (Codegen().reassigned_names.count(name) != 0) {
+        Function *function = TheBuilder().GetInsertBlock()->getParent();
+        variable.value = NULL;
+        variable.slot = create_entry_alloca(function, name);
+        TheBuilder().CreateStore(value, variable.slot);
+    }
+    Codegen().named_values[name] = variable;
+}
+
+Value *variable_codegen(Symbol name) {
+    auto variable = Codegen().named_values.find(name);
+    if (variable == Codegen().named_values.end()) {
+        return ERROR("Unknown variable name '%s'",
+                     Symbols().name(name).c_str());
+    }
+    if (variable->second.slot == NULL) return variable->second.value;
+    return TheBuilder().CreateLoad(variable->second.slot, Symbols().name(name));
+}
+
+bool reassign_codegen(Symbol name, Value *value) {
+    auto variable = Codegen().named_values.find(name);
+    if (variable == Codegen().named_values.end()) return false;
+    if (variable->second.slot == NULL) return false;
+    TheBuilder().CreateStore(value, variable->second.slot);
+    return true;
+}
+
+void finish_function(Function *function, Symbol name, bool ends_with_return) {
+    if (name == SYM_MAIN) {
+        TheBuilder().CreateRet(
+            ConstantInt::get(Type::getInt32Ty(TheContext()), 0));
+    } else if (!ends_with_return) {
+        TheBuilder().CreateRet(
+            ConstantInt::get(Type::getInt64Ty(TheContext()), 0));
+    }
+
+    // function->dump();
+    verifyFunction(*function);
+}
+
+// Each memoized function's table has 2^kMemoBits entries, and a lookup
+// tries kMemoProbes of them before giving up
+static const int kMemoBits = 12;
+static const int kMemoProbes = 4;
+// 2^64 / the golden ratio, which spreads nearby arguments across the table
+static const uint64_t kMemoHashMultiplier = 0x9e3779b97f4a7c15ULL;
+
+// The address of word `field` of the memo table entry starting at `base`.
+// Each entry is the arguments, then the result, then whether it's in use.
+static Value *memo_field(IRBuilder<> *builder, GlobalVariable *table,
+                         Value *base, size_t field) {
+    Value *index = builder->CreateAdd(base, builder->getInt64(field));
+    Value *indices[] = {builder->getInt64(0), index};
+    return builder->CreateInBoundsGEP(table, indices);
+}
+
+void memoize_function(Function *function) {
+    LLVMContext &context = function->getContext();
+    Module *module = function->getParent();
+    Function *body = Function::Create(function->getFunctionType(),
+                                      Function::InternalLinkage,
+                                      function->getName() + ".body", module);
+    body->setDoesNotThrow();
+    body->getBasicBlockList().splice(body->begin(),
+                                     function->getBasicBlockList());
+    std::vector<Value*> args;
+    for (auto from = function->arg_begin(), to = body->arg_begin();
+         from != function->arg_end(); from++, to++) {
+        from->replaceAllUsesWith(&*to);
+        to->takeName(&*from);
+        args.push_back(&*from);
+    }
+
+    size_t arg_count = args.size();
+    size_t stride = arg_count + 2;
+    Type *i64 = Type::getInt64Ty(context);
+    ArrayType *table_type = ArrayType::get(i64, stride << kMemoBits);
+    GlobalVariable *table = new GlobalVariable(
+        *module, table_type, false, GlobalValue::InternalLinkage,
+        ConstantAggregateZero::get(table_type), function->getName() + ".memo");
+
+    BasicBlock *entry = BasicBlock::Create(context, "entry", function);
+    BasicBlock *probe = BasicBlock::Create(context, "probe", function);
+    BasicBlock *compare = BasicBlock::Create(context, "compare", function);
+    BasicBlock *hit = BasicBlock::Create(context, "hit", function);
+    BasicBlock *next = BasicBlock::Create(context, "next", function);
+    BasicBlock *miss = BasicBlock::Create(context, "miss", function);
+    IRBuilder<> builder(entry);
+
+    // The top bits of the hash pick the first entry to try
+    Value *hash = builder.getInt64(0);
+    for (size_t i = 0; i < arg_count; i++) {
+        hash = builder.CreateMul(builder.CreateXor(hash, args[i]),
+                                 builder.getInt64(kMemoHashMultiplier));
+    }
+    Value *start = builder.CreateLShr(hash, 64 - kMemoBits, "start");
+    builder.CreateBr(probe);
+
+    // Stop at the first unused entry, since the arguments would have gone
+    // there. The rest are compared with the arguments.
+    builder.SetInsertPoint(probe);
+    PHINode *attempt = builder.CreatePHI(i64, 2, "attempt");
+    attempt->addIncoming(builder.getInt64(0), entry);
+    Value *index = builder.CreateAnd(builder.CreateAdd(start, attempt),
+                                     (1 << kMemoBits) - 1, "index");
+    Value *base = builder.CreateMul(index, builder.getInt64(stride), "base");
+    Value *used_field = memo_field(&builder, table, base, arg_count + 1);
+    Value *used = builder.CreateLoad(used_field, "used");
+    builder.CreateCondBr(builder.CreateICmpEQ(used, builder.getInt64(0)),
+                         miss, compare);
+
+    builder.SetInsertPoint(compare);
+    Value *same = builder.getTrue();
+    for (size_t i = 0; i < arg_count; i++) {
+        Value *key_field = memo_field(&builder, table, base, i);
+        Value *key = builder.CreateLoad(key_field, "key");
+        same = builder.CreateAnd(same, builder.CreateICmpEQ(key, args[i]));
+    }
+    builder.CreateCondBr(same, hit, next);
+
+    builder.SetInsertPoint(hit);
+    Value *result_field = memo_field(&builder, table, base, arg_count);
+    builder.CreateRet(builder.CreateLoad(result_field, "memo"));
+
+    builder.SetInsertPoint(next);
+    Value *next_attempt = builder.CreateAdd(attempt, builder.getInt64(1));
+    attempt->addIncoming(next_attempt, next);
+    builder.CreateCondBr(builder.CreateICmpEQ(next_attempt,
+                                              builder.getInt64(kMemoProbes)),
+                         miss, probe);
+
+    // Fill in the unused entry, or replace the first one tried if they were
+    // all in use
+    builder.SetInsertPoint(miss);
+    PHINode *slot = builder.CreatePHI(i64, 2, "slot");
+    slot->addIncoming(index, probe);
+    slot->addIncoming(start, next);
+    Value *result = builder.CreateCall(body, args, "result");
+    Value *slot_base = builder.CreateMul(slot, builder.getInt64(stride));
+    for (size_t i = 0; i < arg_count; i++) {
+        builder.CreateStore(args[i],
+                            memo_field(&builder, table, slot_base, i));
+    }
+    builder.CreateStore(result,
+                        memo_field(&builder, table, slot_base, arg_count));
+    builder.CreateStore(builder.getInt64(1), memo_field(&builder, table,
+                                                        slot_base,
+                                                        arg_count + 1));
+    builder.CreateRet(result);
+    verifyFunction(*function);
+}
+
+Function *find_callee(Symbol name, size_t arg_count) {
+    const std::string &callee_name = Symbols().name(name);
+    Function *callee_function = TheModule()->getFunction(callee_name);
+    const std::map<Symbol, size_t> *signatures = Codegen().signatures;
+    if (callee_function == NULL && signatures != NULL) {
+        // Defined later on, or into another thread's module
+        auto signature = signatures->find(name);
+        if (signature != signatures->end()) {
+            callee_function = declare_function(name, signature->second);
+        }
+    }
+    if (callee_function == NULL) {
+        return ERROR("unknown function '%s' referenced", callee_name.c_str());
+    }
+
+    if (callee_function->arg_size() != arg_count) {
+        return ERROR("incorrect number of arguments (%s expected %li, %li given)",
+                     callee_name.c_str(), callee_function->arg_size(),
+                     arg_count);
+    }
+    return callee_function;
+}
+
+Value *callee_codegen(Symbol name, size_t arg_count) {
+    const CodegenContext &codegen = Codegen();
+    if (!codegen.call_through_slots || codegen.signatures == NULL) {
+        return find_callee(name, arg_count);
+    }
+    auto signature = codegen.signatures->find(name);
+    if (signature == codegen.signatures->end()) {
+        return find_callee(name, arg_count);
+    }
+    if (signature->second != arg_count) {
+        return ERROR("incorrect number of arguments "
+                     "(%s expected %li, %li given)",
+                     Symbols().name(name).c_str(), signature->second,
+                     arg_count);
+    }
+    Type *slot_type = function_type(name, arg_count)->getPointerTo();
+    Constant *slot = codegen.module->getOrInsertGlobal(slot_name(name),
+                                                       slot_type);
+    return TheBuilder().CreateLoad(slot, Symbols().name(name));
+}
+
+bool return_call_codegen(Symbol name, const std::vector<Value*> &args) {
+    CodegenContext &codegen = Codegen();
+    BasicBlock *loop = codegen.tail_loop;
+    if (loop != NULL && loop->getParent()->getName() == Symbols().name(name) &&
+        args.size() == codegen.tail_params.size()) {
+        BasicBlock *from = TheBuilder().GetInsertBlock();
+        for (size_t i = 0; i < args.size(); i++) {
+            codegen.tail_params[i]->addIncoming(args[i], from);
+        }
+        TheBuilder().CreateBr(loop);
+        return true;
+    }
+    Value *callee = callee_codegen(name, args.size());
+    if (callee == NULL) return false;
+    // Nothing a Lens function has on its stack is ever passed to another
+    CallInst *call = TheBuilder().CreateCall(callee, args);
+    call->setTailCall();
+    TheBuilder().CreateRet(call);
+    return true;
+}
+
+Value *binary_op_codegen(int op, Value *L, Value *R) {
+    switch (op) {
+    case '+': return TheBuilder().CreateAdd(L, R, "addtmp");
+    case '-': return TheBuilder().CreateSub(L, R, "subtmp");
+    case '*': return TheBuilder().CreateMul(L, R, "multmp");
+    case '/': return TheBuilder().CreateSDiv(L, R, "divtmp");
+    case '<': return TheBuilder().CreateICmpSLT(L, R, "lttmp");
+    case '>': return TheBuilder().CreateICmpSGT(L, R, "gttmp");
+    case tokEq: return TheBuilder().CreateICmpEQ(L, R, "eqtmp");
+    case tokIneq: return TheBuilder().CreateICmpNE(L, R, "neqtmp");
+    case OP_SHIFT_LEFT: return TheBuilder().CreateShl(L, R, "shltmp");
+    default: return ERROR("invalid binary operator");
+    }
+}
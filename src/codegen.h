@@ -0,0 +1,111 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_CODEGEN_H_
+#define LENS_CODEGEN_H_
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include "src/symbol.h"
+
+// Code generation state and helpers shared by the class hierarchy in
+// src/ast.h and the FlatModule in src/flat_ast.h
+
+// A variable in scope. A variable that's never reassigned is just the SSA
+// value it was bound to. The rest get a stack slot in the entry block, which
+// mem2reg turns back into registers.
+struct Variable {
+    llvm::Value *value;
+    llvm::AllocaInst *slot;
+};
+
+// Everything code generation works on. Each thread generating code has one
+// of its own, with its own LLVMContext, since LLVM types and constants can't
+// be shared between threads.
+struct CodegenContext {
+    llvm::LLVMContext *context;
+    llvm::Module *module;
+    llvm::IRBuilder<> builder;
+    // The variables in scope in the function being generated
+    std::map<Symbol, Variable> named_values;
+    // The names that are assigned to with `re` in that function
+    std::set<Symbol> reassigned_names;
+    // The argument counts of every function in the program, so calls to
+    // functions that aren't in `module` (yet) can declare them. May be NULL.
+    const std::map<Symbol, size_t> *signatures;
+    // Call the functions in `signatures` through their slots instead of
+    // directly, see src/lazy_jit.h
+    bool call_through_slots;
+    // The functions that don't touch memory, see find_readnone in
+    // src/effects.h. May be NULL.
+    const std::set<Symbol> *readnone;
+    // The block a function that returns calls to itself loops back to
+    // instead, with a phi for each of its arguments. NULL for the others.
+    llvm::BasicBlock *tail_loop;
+    std::vector<llvm::PHINode*> tail_params;
+
+    CodegenContext(llvm::LLVMContext *context, llvm::Module *module);
+};
+
+// The current thread's context. Until one is set, that's the main one, which
+// generates into TheModule().
+CodegenContext &Codegen();
+// Makes `context` the current thread's, and returns the one it replaces
+CodegenContext *set_codegen_context(CodegenContext *context);
+llvm::LLVMContext &TheContext();
+llvm::IRBuilder<> &TheBuilder();
+
+// Declares printf and printi64 in `module`. generate_prelude also defines
+// printi64, which only one module in a program may do.
+void declare_prelude(llvm::Module *module);
+void generate_prelude(llvm::Module *module);
+
+// (i64, i64, ...) -> i64 with `arg_count` arguments, or () -> i32 for main
+llvm::FunctionType *function_type(Symbol name, size_t arg_count);
+// The global holding the address to call for `name` with call_through_slots
+std::string slot_name(Symbol name);
+// Creates the declaration of a function taking `arg_count` i64s, or returns
+// the existing one if the function has only been declared so far. The
+// declaration carries what's known about the function, so calls to it can
+// be optimized even before (or without) its body being in the module.
+llvm::Function *declare_function(Symbol name, size_t arg_count);
+// Names the arguments of `function` and binds them as variables. With
+// `tail_loop`, they're bound to the phis of a loop after the entry block
+// instead, for return_call_codegen to branch back to.
+void arguments_codegen(llvm::Function *function, const Symbol *names,
+                       bool tail_loop);
+// Binds `name` to `value`, giving it a slot if it's reassigned
+void bind_variable(Symbol name, llvm::Value *value);
+llvm::Value *variable_codegen(Symbol name);
+bool reassign_codegen(Symbol name, llvm::Value *value);
+// Adds the implicit return at the end of a function body, and verifies it
+void finish_function(llvm::Function *function, Symbol name,
+                     bool ends_with_return);
+// Moves the body of `function` into an internal <name>.body function, and
+// makes `function` look its arguments up in a memo table first, calling the
+// body only on a miss. The table is a fixed size open addressing hash table
+// in a global. Recursive calls still go to `function`, so they're memoized
+// too. Only for functions whose result depends only on their arguments.
+void memoize_function(llvm::Function *function);
+// Finds the function being called, checking the number of arguments. Known
+// functions that aren't in the module are declared.
+llvm::Function *find_callee(Symbol name, size_t arg_count);
+// The value a call to `name` calls: the function from find_callee, or the
+// address loaded from its slot
+llvm::Value *callee_codegen(Symbol name, size_t arg_count);
+// Returns the result of calling `name` on `args`. A function returning a
+// call to itself passes the arguments back around its tail loop, so it
+// runs in constant stack at any depth. Other calls are marked as tail
+// calls, which LLVM turns into jumps where the target allows it.
+bool return_call_codegen(Symbol name, const std::vector<llvm::Value*> &args);
+llvm::Value *binary_op_codegen(int op, llvm::Value *lhs, llvm::Value *rhs);
+
+#endif  // LENS_CODEGEN_H_
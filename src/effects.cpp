@@ -0,0 +1,184 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/effects.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+// ========================================================================= //
+// Expressions
+// ========================================================================= //
+void BinaryExprAST::find_callees(std::set<Symbol> *names) const {
+    lhs->find_callees(names);
+    rhs->find_callees(names);
+}
+
+void CallAST::find_callees(std::set<Symbol> *names) const {
+    names->insert(name);
+    find_argument_callees(names);
+}
+
+void CallAST::find_argument_callees(std::set<Symbol> *names) const {
+    for (auto iter = args.begin(); iter != args.end(); iter++) {
+        (*iter)->find_callees(names);
+    }
+}
+
+// ========================================================================= //
+// Statements
+// ========================================================================= //
+void AssignmentAST::find_callees(std::set<Symbol> *names) const {
+    rhs->find_callees(names);
+}
+
+void ReassignAST::find_callees(std::set<Symbol> *names) const {
+    rhs->find_callees(names);
+}
+
+void ReturnAST::find_callees(std::set<Symbol> *names) const {
+    rvalue->find_callees(names);
+}
+
+void ReturnAST::find_non_tail_callees(std::set<Symbol> *names) const {
+    if (rvalue->type() == CALL_AST) {
+        static_cast<CallAST*>(rvalue)->find_argument_callees(names);
+    } else {
+        rvalue->find_callees(names);
+    }
+}
+
+void IfElseAST::find_callees(std::set<Symbol> *names) const {
+    condition->find_callees(names);
+    for (auto iter = ifbody.begin(); iter != ifbody.end(); iter++) {
+        (*iter)->find_callees(names);
+    }
+    for (auto iter = elsebody.begin(); iter != elsebody.end(); iter++) {
+        (*iter)->find_callees(names);
+    }
+}
+
+void IfElseAST::find_non_tail_callees(std::set<Symbol> *names) const {
+    condition->find_callees(names);
+    for (auto iter = ifbody.begin(); iter != ifbody.end(); iter++) {
+        (*iter)->find_non_tail_callees(names);
+    }
+    for (auto iter = elsebody.begin(); iter != elsebody.end(); iter++) {
+        (*iter)->find_non_tail_callees(names);
+    }
+}
+
+// ========================================================================= //
+// Functions
+// ========================================================================= //
+void FunctionAST::find_callees(std::set<Symbol> *names) const {
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        (*iter)->find_callees(names);
+    }
+}
+
+void FunctionAST::find_non_tail_callees(std::set<Symbol> *names) const {
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        (*iter)->find_non_tail_callees(names);
+    }
+}
+
+// ========================================================================= //
+// CallGraph
+// ========================================================================= //
+CallGraph::CallGraph(const std::vector<FunctionAST*> &program) {
+    for (auto iter = program.begin(); iter != program.end(); iter++) {
+        Symbol name = (*iter)->name();
+        if (callees.count(name) != 0) continue;
+        (*iter)->find_callees(&callees[name]);
+        (*iter)->find_non_tail_callees(&non_tail_callees[name]);
+        pure.insert(name);
+    }
+    // Start out with every function pure, then take away the ones that call
+    // something that isn't until nothing changes. That way a function that
+    // calls itself can still be pure. The prelude's functions print, so
+    // they were never in `pure` to begin with.
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto function = callees.begin(); function != callees.end();
+             function++) {
+            if (pure.count(function->first) == 0) continue;
+            for (auto callee = function->second.begin();
+                 callee != function->second.end(); callee++) {
+                if (pure.count(*callee) == 0) {
+                    pure.erase(function->first);
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool CallGraph::can_reach(Symbol name,
+                          const std::set<Symbol> &targets) const {
+    // Search everything reachable from `name`'s callees for a target
+    std::set<Symbol> seen;
+    std::vector<Symbol> stack;
+    stack.push_back(name);
+    while (!stack.empty()) {
+        auto function = callees.find(stack.back());
+        stack.pop_back();
+        if (function == callees.end()) continue;
+        for (auto callee = function->second.begin();
+             callee != function->second.end(); callee++) {
+            if (targets.count(*callee) != 0) return true;
+            if (seen.insert(*callee).second) stack.push_back(*callee);
+        }
+    }
+    return false;
+}
+
+bool CallGraph::grows_stack(Symbol name) const {
+    std::set<Symbol> self;
+    self.insert(name);
+    auto function = non_tail_callees.find(name);
+    if (function == non_tail_callees.end()) return false;
+    for (auto callee = function->second.begin();
+         callee != function->second.end(); callee++) {
+        if (*callee == name || can_reach(*callee, self)) return true;
+    }
+    return false;
+}
+
+size_t mark_memoized(const std::vector<FunctionAST*> &program) {
+    CallGraph graph(program);
+    size_t marked = 0;
+    for (auto iter = program.begin(); iter != program.end(); iter++) {
+        Symbol name = (*iter)->name();
+        // Without arguments there'd be one result, which a pure function
+        // that calls itself never gets to. A function that only gets back
+        // to itself through tail calls sees each argument once per call
+        // from outside, and runs in constant stack, which the table's
+        // wrapper would stop.
+        if (name == SYM_MAIN || (*iter)->arg_count() == 0 ||
+            !graph.is_pure(name) || !graph.grows_stack(name)) {
+            continue;
+        }
+        (*iter)->set_memoized(true);
+        marked++;
+    }
+    return marked;
+}
+
+std::set<Symbol> find_readnone(const std::vector<FunctionAST*> &program) {
+    CallGraph graph(program);
+    std::set<Symbol> memoized;
+    for (auto iter = program.begin(); iter != program.end(); iter++) {
+        if ((*iter)->memoized()) memoized.insert((*iter)->name());
+    }
+    std::set<Symbol> readnone;
+    for (auto iter = program.begin(); iter != program.end(); iter++) {
+        Symbol name = (*iter)->name();
+        if (graph.is_pure(name) && memoized.count(name) == 0 &&
+            !graph.can_reach(name, memoized)) {
+            readnone.insert(name);
+        }
+    }
+    return readnone;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_EFFECTS_H_
+#define LENS_EFFECTS_H_
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "src/ast.h"
+#include "src/symbol.h"
+
+// Which functions each function of a program calls, and what that says
+// about them. A function is pure if neither it nor anything it calls
+// prints, so calling it with the same arguments always gives the same
+// result and does nothing else. Only the first definition of a name
+// counts, the same as in the interpreter.
+class CallGraph {
+    std::map<Symbol, std::set<Symbol>> callees;
+    // The same, without the calls made as `return f(...)`
+    std::map<Symbol, std::set<Symbol>> non_tail_callees;
+    std::set<Symbol> pure;
+
+ public:
+    explicit CallGraph(const std::vector<FunctionAST*> &program);
+    bool is_pure(Symbol name) const { return pure.count(name) != 0; }
+    // Whether `name` can end up calling one of `targets`
+    bool can_reach(Symbol name, const std::set<Symbol> &targets) const;
+    // Whether `name` can end up calling itself other than through tail
+    // calls, which would take more stack the deeper it goes
+    bool grows_stack(Symbol name) const;
+};
+
+// Marks the pure functions of `program` that take arguments and grow the
+// stack calling themselves to be memoized, see memoize_function in
+// src/codegen.h. Returns how many were marked.
+size_t mark_memoized(const std::vector<FunctionAST*> &program);
+
+// The functions of `program` that neither read nor write memory, so LLVM
+// can combine calls to them with the same arguments and move them out of
+// loops. These are the pure ones that can't reach a memoized function,
+// since those keep their results in a table. Call after mark_memoized.
+std::set<Symbol> find_readnone(const std::vector<FunctionAST*> &program);
+
+#endif  // LENS_EFFECTS_H_
@@ -0,0 +1,218 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/flat_ast.h"
+
+#include <iostream>
+#include <vector>
+
+// ========================================================================= //
+// Building
+// ========================================================================= //
+NodeRef FlatModule::add_number(int64_t integer_value, double float_value,
+                               bool is_integer) {
+    FlatNumber number = {integer_value, float_value, is_integer};
+    numbers.push_back(number);
+    return make_node_ref(NUMBER_AST, numbers.size() - 1);
+}
+
+NodeRef FlatModule::add_variable(Symbol name) {
+    variables.push_back(name);
+    return make_node_ref(VARIABLE_AST, variables.size() - 1);
+}
+
+NodeRef FlatModule::add_binary_expr(NodeRef lhs, int op, NodeRef rhs) {
+    FlatBinaryExpr expr = {op, lhs, rhs};
+    binary_exprs.push_back(expr);
+    return make_node_ref(BINARY_EXPR_AST, binary_exprs.size() - 1);
+}
+
+NodeRef FlatModule::add_call(Symbol name, NodeList args) {
+    FlatCall call = {name, args};
+    calls.push_back(call);
+    return make_node_ref(CALL_AST, calls.size() - 1);
+}
+
+NodeRef FlatModule::add_assignment(Symbol name, NodeRef rhs) {
+    FlatAssignment assignment = {name, rhs};
+    assignments.push_back(assignment);
+    return make_node_ref(ASSIGNMENT_AST, assignments.size() - 1);
+}
+
+NodeRef FlatModule::add_reassign(Symbol name, NodeRef rhs) {
+    FlatAssignment reassign = {name, rhs};
+    reassigns.push_back(reassign);
+    return make_node_ref(REASSIGN_AST, reassigns.size() - 1);
+}
+
+NodeRef FlatModule::add_return(NodeRef rvalue) {
+    returns.push_back(rvalue);
+    return make_node_ref(RETURN_AST, returns.size() - 1);
+}
+
+NodeRef FlatModule::add_if_else(NodeRef condition, NodeList ifbody,
+                                NodeList elsebody) {
+    FlatIfElse if_else = {condition, ifbody, elsebody};
+    if_elses.push_back(if_else);
+    return make_node_ref(IF_ELSE_AST, if_elses.size() - 1);
+}
+
+uint32_t FlatModule::add_function(Symbol name, NodeList params,
+                                  NodeList body, bool memoized) {
+    FlatFunction function = {name, params, body, memoized};
+    functions.push_back(function);
+    return functions.size() - 1;
+}
+
+NodeList FlatModule::pop_children(size_t mark) {
+    NodeList list = {static_cast<uint32_t>(children.size()),
+                     static_cast<uint32_t>(child_stack.size() - mark)};
+    children.insert(children.end(), child_stack.begin() + mark,
+                    child_stack.end());
+    child_stack.resize(mark);
+    return list;
+}
+
+NodeList FlatModule::add_params(const ArenaArray<Symbol> &names) {
+    NodeList list = {static_cast<uint32_t>(params.size()),
+                     static_cast<uint32_t>(names.size())};
+    params.insert(params.end(), names.begin(), names.end());
+    return list;
+}
+
+// ========================================================================= //
+// Flattening the class hierarchy
+// ========================================================================= //
+NodeRef NumberAST::flatten(FlatModule *module) const {
+    return module->add_number(integer_value, float_value, is_integer);
+}
+
+NodeRef VariableAST::flatten(FlatModule *module) const {
+    return module->add_variable(name);
+}
+
+NodeRef BinaryExprAST::flatten(FlatModule *module) const {
+    NodeRef left = lhs->flatten(module);
+    NodeRef right = rhs->flatten(module);
+    return module->add_binary_expr(left, op, right);
+}
+
+NodeRef CallAST::flatten(FlatModule *module) const {
+    size_t mark = module->child_mark();
+    for (auto iter = args.begin(); iter != args.end(); iter++) {
+        module->push_child((*iter)->flatten(module));
+    }
+    return module->add_call(name, module->pop_children(mark));
+}
+
+NodeRef AssignmentAST::flatten(FlatModule *module) const {
+    return module->add_assignment(name, rhs->flatten(module));
+}
+
+NodeRef ReassignAST::flatten(FlatModule *module) const {
+    return module->add_reassign(name, rhs->flatten(module));
+}
+
+NodeRef ReturnAST::flatten(FlatModule *module) const {
+    return module->add_return(rvalue->flatten(module));
+}
+
+NodeRef IfElseAST::flatten(FlatModule *module) const {
+    NodeRef cond = condition->flatten(module);
+    size_t mark = module->child_mark();
+    for (auto iter = ifbody.begin(); iter != ifbody.end(); iter++) {
+        module->push_child((*iter)->flatten(module));
+    }
+    NodeList flat_ifbody = module->pop_children(mark);
+    for (auto iter = elsebody.begin(); iter != elsebody.end(); iter++) {
+        module->push_child((*iter)->flatten(module));
+    }
+    NodeList flat_elsebody = module->pop_children(mark);
+    return module->add_if_else(cond, flat_ifbody, flat_elsebody);
+}
+
+uint32_t FunctionAST::flatten(FlatModule *module) const {
+    size_t mark = module->child_mark();
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        module->push_child((*iter)->flatten(module));
+    }
+    NodeList flat_body = module->pop_children(mark);
+    return module->add_function(proto->name, module->add_params(proto->args),
+                                flat_body, memoize);
+}
+
+// ========================================================================= //
+// Printing
+// ========================================================================= //
+void FlatModule::print(std::ostream *out, NodeRef ref) const {
+    uint32_t index = node_index(ref);
+    switch (node_kind(ref)) {
+    case NUMBER_AST: {
+        const FlatNumber &number = numbers[index];
+        if (number.is_integer) {
+            *out << number.integer_value;
+        } else {
+            *out << number.float_value;
+        }
+        break;
+    }
+    case VARIABLE_AST:
+        *out << Symbols().name(variables[index]);
+        break;
+    case BINARY_EXPR_AST: {
+        const FlatBinaryExpr &expr = binary_exprs[index];
+        *out << "(";
+        print(out, expr.lhs);
+        *out << " " << binary_op_name(expr.op) << " ";
+        print(out, expr.rhs);
+        *out << ")";
+        break;
+    }
+    case CALL_AST: {
+        const FlatCall &call = calls[index];
+        *out << Symbols().name(call.name) << "(";
+        for (uint32_t i = 0; i < call.args.count; i++) {
+            print(out, children[call.args.first + i]);
+            *out << ", ";
+        }
+        *out << ")";
+        break;
+    }
+    case ASSIGNMENT_AST:
+        *out << "let " << Symbols().name(assignments[index].name) << " = ";
+        print(out, assignments[index].rhs);
+        break;
+    case REASSIGN_AST:
+        *out << Symbols().name(reassigns[index].name) << " = ";
+        print(out, reassigns[index].rhs);
+        break;
+    case RETURN_AST:
+        *out << "return ";
+        print(out, returns[index]);
+        break;
+    case IF_ELSE_AST:
+        *out << "IF: ";
+        print(out, if_elses[index].condition);
+        *out << "\n";
+        print_body(out, if_elses[index].ifbody);
+        *out << "    ELSE:\n";
+        print_body(out, if_elses[index].elsebody);
+        break;
+    }
+}
+
+void FlatModule::print_body(std::ostream *out, NodeList body) const {
+    for (uint32_t i = 0; i < body.count; i++) {
+        *out << "    ";
+        print(out, children[body.first + i]);
+        *out << "\n";
+    }
+}
+
+void FlatModule::print_function(std::ostream *out, uint32_t function) const {
+    const FlatFunction &f = functions[function];
+    *out << Symbols().name(f.name) << "(";
+    for (uint32_t i = 0; i < f.params.count; i++) {
+        *out << Symbols().name(params[f.params.first + i]) << ", ";
+    }
+    *out << "):\n";
+    print_body(out, f.body);
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_FLAT_AST_H_
+#define LENS_FLAT_AST_H_
+
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Value.h"
+
+#include "src/ast.h"
+#include "src/symbol.h"
+
+// A flat copy of the AST. Instead of a tree of objects, every kind of node
+// lives in its own array, and nodes refer to each other with NodeRefs. A
+// NodeRef holds the kind of the node (from AST_TYPES) in its top 4 bits and
+// its index into that kind's array in the rest.
+static const int kNodeKindShift = 28;
+static const uint32_t kNodeIndexMask = (1u << kNodeKindShift) - 1;
+
+inline NodeRef make_node_ref(int kind, size_t index) {
+    return (static_cast<uint32_t>(kind) << kNodeKindShift) |
+           static_cast<uint32_t>(index);
+}
+inline int node_kind(NodeRef ref) { return ref >> kNodeKindShift; }
+inline uint32_t node_index(NodeRef ref) { return ref & kNodeIndexMask; }
+
+// A run of entries in FlatModule::children or FlatModule::params
+struct NodeList {
+    uint32_t first;
+    uint32_t count;
+};
+
+struct FlatNumber {
+    int64_t integer_value;
+    double float_value;
+    bool is_integer;
+};
+
+// <lhs> <op> <rhs>
+struct FlatBinaryExpr {
+    int op;
+    NodeRef lhs, rhs;
+};
+
+// <name>(<args>, ...)
+struct FlatCall {
+    Symbol name;
+    NodeList args;
+};
+
+// let <name> = <rhs>, and <name> = <rhs>
+struct FlatAssignment {
+    Symbol name;
+    NodeRef rhs;
+};
+
+struct FlatIfElse {
+    NodeRef condition;
+    NodeList ifbody;
+    NodeList elsebody;
+};
+
+struct FlatFunction {
+    Symbol name;
+    NodeList params;
+    NodeList body;
+    // See FunctionAST::memoized
+    bool memoized;
+};
+
+class FlatModule {
+    // Child refs waiting to be copied into `children`, see push_child
+    std::vector<NodeRef> child_stack;
+
+    void print_body(std::ostream *out, NodeList body) const;
+    bool ends_with_return(NodeList body) const;
+    bool body_codegen(NodeList body);
+    void find_reassigned(NodeList body, std::set<Symbol> *names) const;
+    bool returns_call_to(NodeList body, Symbol name) const;
+
+ public:
+    // One array for each kind of node, indexed by node_index()
+    std::vector<FlatNumber> numbers;
+    std::vector<Symbol> variables;
+    std::vector<FlatBinaryExpr> binary_exprs;
+    std::vector<FlatCall> calls;
+    std::vector<FlatAssignment> assignments;
+    std::vector<FlatAssignment> reassigns;
+    std::vector<NodeRef> returns;
+    std::vector<FlatIfElse> if_elses;
+    std::vector<FlatFunction> functions;
+    // The lists of children of calls, ifs and functions
+    std::vector<NodeRef> children;
+    std::vector<Symbol> params;
+
+    NodeRef add_number(int64_t integer_value, double float_value,
+                       bool is_integer);
+    NodeRef add_variable(Symbol name);
+    NodeRef add_binary_expr(NodeRef lhs, int op, NodeRef rhs);
+    NodeRef add_call(Symbol name, NodeList args);
+    NodeRef add_assignment(Symbol name, NodeRef rhs);
+    NodeRef add_reassign(Symbol name, NodeRef rhs);
+    NodeRef add_return(NodeRef rvalue);
+    NodeRef add_if_else(NodeRef condition, NodeList ifbody, NodeList elsebody);
+    uint32_t add_function(Symbol name, NodeList params, NodeList body,
+                          bool memoized);
+
+    // Children are flattened one at a time, so their own children would end
+    // up in between them. Instead each one is pushed here as it's finished,
+    // and pop_children moves everything pushed since `mark` into `children`
+    // in one contiguous NodeList.
+    size_t child_mark() const { return child_stack.size(); }
+    void push_child(NodeRef child) { child_stack.push_back(child); }
+    NodeList pop_children(size_t mark);
+    NodeList add_params(const ArenaArray<Symbol> &names);
+
+    // Same output as the operator<< of the class hierarchy
+    void print(std::ostream *out, NodeRef ref) const;
+    void print_function(std::ostream *out, uint32_t function) const;
+
+    llvm::Value *expr_codegen(NodeRef ref);
+    bool codegen(NodeRef ref);
+    llvm::Function *function_codegen(uint32_t function);
+};
+
+#endif  // LENS_FLAT_AST_H_
@@ -0,0 +1,195 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/flat_ast.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "src/codegen.h"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/LLVMContext.h"
+
+#define ERROR(msg, ...) (printf("Code generation error: " msg "\n", \
+##__VA_ARGS__), nullptr)
+#define ERRORB(msg, ...) (printf("Code generation error: " msg "\n", \
+##__VA_ARGS__), false)
+
+using namespace llvm;
+
+// Code generation for the FlatModule. This emits exactly the same IR as the
+// codegen() methods in src/ast.cpp, but walks the node arrays with a switch
+// on the node kind instead of calling through the vtables.
+
+Value *FlatModule::expr_codegen(NodeRef ref) {
+    uint32_t index = node_index(ref);
+    switch (node_kind(ref)) {
+    case NUMBER_AST:
+        return ConstantInt::get(Type::getInt64Ty(TheContext()),
+                                numbers[index].integer_value, true);
+    case VARIABLE_AST:
+        return variable_codegen(variables[index]);
+    case BINARY_EXPR_AST: {
+        const FlatBinaryExpr &expr = binary_exprs[index];
+        Value *L = expr_codegen(expr.lhs);
+        Value *R = expr_codegen(expr.rhs);
+        if (L == NULL || R == NULL) return NULL;
+        return binary_op_codegen(expr.op, L, R);
+    }
+    case CALL_AST: {
+        const FlatCall &call = calls[index];
+        Value *callee = callee_codegen(call.name, call.args.count);
+        if (callee == NULL) return NULL;
+
+        std::vector<Value*> argv;
+        for (uint32_t i = 0; i < call.args.count; i++) {
+            argv.push_back(expr_codegen(children[call.args.first + i]));
+            if (argv.back() == NULL) return NULL;
+        }
+        return TheBuilder().CreateCall(callee, argv);
+    }
+    default:
+        return ERROR("statement used as an expression");
+    }
+}
+
+bool FlatModule::ends_with_return(NodeList body) const {
+    return body.count > 0 &&
+           node_kind(children[body.first + body.count - 1]) == RETURN_AST;
+}
+
+void FlatModule::find_reassigned(NodeList body,
+                                 std::set<Symbol> *names) const {
+    for (uint32_t i = 0; i < body.count; i++) {
+        NodeRef ref = children[body.first + i];
+        if (node_kind(ref) == REASSIGN_AST) {
+            names->insert(reassigns[node_index(ref)].name);
+        } else if (node_kind(ref) == IF_ELSE_AST) {
+            find_reassigned(if_elses[node_index(ref)].ifbody, names);
+            find_reassigned(if_elses[node_index(ref)].elsebody, names);
+        }
+    }
+}
+
+bool FlatModule::returns_call_to(NodeList body, Symbol name) const {
+    for (uint32_t i = 0; i < body.count; i++) {
+        NodeRef ref = children[body.first + i];
+        if (node_kind(ref) == RETURN_AST) {
+            NodeRef rvalue = returns[node_index(ref)];
+            if (node_kind(rvalue) == CALL_AST &&
+                calls[node_index(rvalue)].name == name) {
+                return true;
+            }
+        } else if (node_kind(ref) == IF_ELSE_AST) {
+            const FlatIfElse &if_else = if_elses[node_index(ref)];
+            if (returns_call_to(if_else.ifbody, name) ||
+                returns_call_to(if_else.elsebody, name)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool FlatModule::body_codegen(NodeList body) {
+    for (uint32_t i = 0; i < body.count; i++) {
+        if (!codegen(children[body.first + i])) return false;
+    }
+    return true;
+}
+
+bool FlatModule::codegen(NodeRef ref) {
+    uint32_t index = node_index(ref);
+    switch (node_kind(ref)) {
+    case ASSIGNMENT_AST: {
+        const FlatAssignment &assignment = assignments[index];
+        auto value = expr_codegen(assignment.rhs);
+        if (value == NULL) return false;
+        bind_variable(assignment.name, value);
+        return true;
+    }
+    case REASSIGN_AST: {
+        const FlatAssignment &reassign = reassigns[index];
+        auto value = expr_codegen(reassign.rhs);
+        if (value == NULL) return false;
+        return reassign_codegen(reassign.name, value);
+    }
+    case RETURN_AST: {
+        NodeRef rvalue = returns[index];
+        if (node_kind(rvalue) == CALL_AST) {
+            const FlatCall &call = calls[node_index(rvalue)];
+            std::vector<Value*> argv;
+            for (uint32_t i = 0; i < call.args.count; i++) {
+                argv.push_back(expr_codegen(children[call.args.first + i]));
+                if (argv.back() == NULL) return false;
+            }
+            return return_call_codegen(call.name, argv);
+        }
+        auto result = expr_codegen(rvalue);
+        if (result == NULL) return false;
+        TheBuilder().CreateRet(result);
+        return true;
+    }
+    case IF_ELSE_AST: {
+        const FlatIfElse &if_else = if_elses[index];
+        Function *fn = TheBuilder().GetInsertBlock()->getParent();
+        BasicBlock *ifbb = BasicBlock::Create(TheContext(), "if", fn);
+        BasicBlock *elsebb = BasicBlock::Create(TheContext(), "else");
+        BasicBlock *mergebb = BasicBlock::Create(TheContext(), "ifcont");
+
+        Value *condval = expr_codegen(if_else.condition);
+        if (condval == NULL) {
+            return ERRORB("failed generating condition for if");
+        }
+        TheBuilder().CreateCondBr(condval, ifbb, elsebb);
+
+        // Variables bound in a branch are scoped to it
+        std::map<Symbol, Variable> outer_scope = Codegen().named_values;
+
+        TheBuilder().SetInsertPoint(ifbb);
+        if (!body_codegen(if_else.ifbody)) {
+            return ERRORB("failed generating statement in if");
+        }
+        Codegen().named_values = outer_scope;
+        if (!ends_with_return(if_else.ifbody)) TheBuilder().CreateBr(mergebb);
+
+        fn->getBasicBlockList().push_back(elsebb);
+        TheBuilder().SetInsertPoint(elsebb);
+        if (!body_codegen(if_else.elsebody)) {
+            return ERRORB("failed generating statement in if");
+        }
+        Codegen().named_values = outer_scope;
+        if (!ends_with_return(if_else.elsebody)) TheBuilder().CreateBr(mergebb);
+
+        fn->getBasicBlockList().push_back(mergebb);
+        TheBuilder().SetInsertPoint(mergebb);
+        return true;
+    }
+    default:
+        return expr_codegen(ref) != NULL;
+    }
+}
+
+Function *FlatModule::function_codegen(uint32_t index) {
+    const FlatFunction &f = functions[index];
+    Codegen().named_values.clear();
+    Codegen().reassigned_names.clear();
+    find_reassigned(f.body, &Codegen().reassigned_names);
+
+    Function *function = declare_function(f.name, f.params.count);
+    if (function == NULL) {
+        return ERROR("Error generating function prototype");
+    }
+
+    BasicBlock *bb = BasicBlock::Create(TheContext(), "entry", function);
+    TheBuilder().SetInsertPoint(bb);
+    arguments_codegen(function, params.data() + f.params.first,
+                      returns_call_to(f.body, f.name));
+
+    if (!body_codegen(f.body)) {
+        return ERROR("Error generating function code");
+    }
+    finish_function(function, f.name, ends_with_return(f.body));
+    if (f.memoized) memoize_function(function);
+    return function;
+}
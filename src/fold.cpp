@@ -0,0 +1,261 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/fold.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "src/arith.h"
+#include "src/options.h"
+
+// ========================================================================= //
+// Expressions
+// ========================================================================= //
+ExprAST *NumberAST::fold_expr(ConstantFolder *folder) {
+    return this;
+}
+
+ExprAST *VariableAST::fold_expr(ConstantFolder *folder) {
+    return this;
+}
+
+static bool is_number(const ExprAST *expr) {
+    return const_cast<ExprAST*>(expr)->type() == NUMBER_AST;
+}
+
+static int64_t number_value(const ExprAST *expr) {
+    return static_cast<const NumberAST*>(expr)->value();
+}
+
+// Whether `expr` can be dropped without skipping anything it does
+static bool is_leaf(const ExprAST *expr) {
+    int type = const_cast<ExprAST*>(expr)->type();
+    return type == NUMBER_AST || type == VARIABLE_AST;
+}
+
+// Works out `L op R` into `result`. Comparisons give an i1, not an i64, so
+// they're left alone, and so is dividing by zero, which is an error at run
+// time.
+static bool fold_arithmetic(int op, int64_t L, int64_t R, int64_t *result) {
+    switch (op) {
+    case '+': *result = wrapping_add(L, R); return true;
+    case '-': *result = wrapping_sub(L, R); return true;
+    case '*': *result = wrapping_mul(L, R); return true;
+    case '/':
+        if (R == 0) return false;
+        *result = wrapping_div(L, R);
+        return true;
+    case OP_SHIFT_LEFT: *result = wrapping_shl(L, R); return true;
+    default: return false;
+    }
+}
+
+// Returns n if `value` is 2^n for some n > 0, or 0 if it isn't
+static int power_of_two(int64_t value) {
+    uint64_t bits = value;
+    if (bits < 2 || (bits & (bits - 1)) != 0) return 0;
+    int shift = 0;
+    while (bits > 1) {
+        bits >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+ExprAST *BinaryExprAST::fold_expr(ConstantFolder *folder) {
+    lhs = lhs->fold_expr(folder);
+    rhs = rhs->fold_expr(folder);
+    int64_t result;
+    if (is_number(lhs) && is_number(rhs) &&
+        fold_arithmetic(op, number_value(lhs), number_value(rhs), &result)) {
+        folder->count_folded();
+        return folder->make_number(result);
+    }
+    // Keep constants on the right of + and *, so that's the only place the
+    // rules below have to look for them
+    if ((op == '+' || op == '*') && is_number(lhs)) std::swap(lhs, rhs);
+    if (op == '-' && lhs->type() == VARIABLE_AST &&
+        rhs->type() == VARIABLE_AST &&
+        static_cast<VariableAST*>(lhs)->symbol() ==
+        static_cast<VariableAST*>(rhs)->symbol()) {
+        folder->count_folded();
+        return folder->make_number(0);
+    }
+    if (is_number(rhs)) return fold_constant_rhs(folder, number_value(rhs));
+    return this;
+}
+
+// Simplifies `lhs op value`, where `value` is the constant in `rhs`
+ExprAST *BinaryExprAST::fold_constant_rhs(ConstantFolder *folder,
+                                          int64_t value) {
+    // If lhs is the same kind of operation with a constant, the two
+    // constants can be combined
+    BinaryExprAST *inner = NULL;
+    if (lhs->type() == BINARY_EXPR_AST) {
+        inner = static_cast<BinaryExprAST*>(lhs);
+        if (!is_number(inner->rhs)) inner = NULL;
+    }
+    switch (op) {
+    case '+':
+    case '-': {
+        if (inner == NULL || (inner->op != '+' && inner->op != '-')) {
+            if (value != 0) return this;
+            folder->count_folded();
+            return lhs;
+        }
+        // Add up x + a - b + c ... as one offset
+        uint64_t offset = op == '+' ? value : 0 - static_cast<uint64_t>(value);
+        uint64_t inner_value = number_value(inner->rhs);
+        offset += inner->op == '+' ? inner_value : 0 - inner_value;
+        lhs = inner->lhs;
+        folder->count_folded();
+        if (offset == 0) return lhs;
+        op = wrap(offset) < 0 && wrap(offset) != INT64_MIN ? '-' : '+';
+        rhs = folder->make_number(op == '+' ? wrap(offset) : wrap(0 - offset));
+        return this;
+    }
+    case '*':
+        if (inner != NULL &&
+            (inner->op == '*' || inner->op == OP_SHIFT_LEFT)) {
+            // (x << n) * c is x * (c << n)
+            int64_t inner_value = number_value(inner->rhs);
+            fold_arithmetic(inner->op, value, inner_value, &value);
+            lhs = inner->lhs;
+            rhs = folder->make_number(value);
+            folder->count_folded();
+        }
+        if (value == 1) {
+            folder->count_folded();
+            return lhs;
+        }
+        if (value == 0 && is_leaf(lhs)) {
+            folder->count_folded();
+            return folder->make_number(0);
+        }
+        if (int shift = power_of_two(value)) {
+            op = OP_SHIFT_LEFT;
+            rhs = folder->make_number(shift);
+            folder->count_folded();
+        }
+        return this;
+    case '/':
+        // Dividing by a power of two isn't a shift, since a shift rounds
+        // negative numbers down instead of towards zero, and the sequence
+        // that fixes that up is longer than the division LLVM turns into it
+        if (value == 1) {
+            folder->count_folded();
+            return lhs;
+        }
+        if (value == -1) {
+            op = '-';
+            rhs = lhs;
+            lhs = folder->make_number(0);
+            folder->count_folded();
+        }
+        return this;
+    default:
+        return this;
+    }
+}
+
+ExprAST *CallAST::fold_expr(ConstantFolder *folder) {
+    std::vector<int64_t> values;
+    for (auto iter = args.begin(); iter != args.end(); iter++) {
+        *iter = (*iter)->fold_expr(folder);
+        if ((*iter)->type() == NUMBER_AST) {
+            values.push_back(static_cast<NumberAST*>(*iter)->value());
+        }
+    }
+    int64_t result;
+    if (values.size() != args.size() ||
+        !folder->evaluate_call(name, values, &result)) {
+        return this;
+    }
+    return folder->make_number(result);
+}
+
+// ========================================================================= //
+// Statements
+// ========================================================================= //
+StatementAST *AssignmentAST::fold(ConstantFolder *folder) {
+    rhs = rhs->fold_expr(folder);
+    return this;
+}
+
+StatementAST *ReassignAST::fold(ConstantFolder *folder) {
+    rhs = rhs->fold_expr(folder);
+    return this;
+}
+
+StatementAST *ReturnAST::fold(ConstantFolder *folder) {
+    rvalue = rvalue->fold_expr(folder);
+    return this;
+}
+
+StatementAST *IfElseAST::fold(ConstantFolder *folder) {
+    condition = condition->fold_expr(folder);
+    folder->fold_body(ifbody);
+    folder->fold_body(elsebody);
+    return this;
+}
+
+// ========================================================================= //
+// Functions
+// ========================================================================= //
+void FunctionAST::fold(ConstantFolder *folder) {
+    folder->fold_body(body);
+}
+
+// ========================================================================= //
+// ConstantFolder
+// ========================================================================= //
+ConstantFolder::ConstantFolder(const std::vector<FunctionAST*> &program,
+                               Arena *arena, const Options &options)
+    : arena(arena), interpreter(program, options), graph(program),
+      steps_per_call(options.eval_steps), steps_left(options.eval_total),
+      folded(0) {}
+
+bool ConstantFolder::evaluate_call(Symbol name,
+                                   const std::vector<int64_t> &args,
+                                   int64_t *value) {
+    // main is the program itself, and returns an i32, so it's never folded
+    if (steps_per_call == 0 || steps_left == 0 || name == SYM_MAIN ||
+        !graph.is_pure(name)) {
+        return false;
+    }
+    auto key = std::make_pair(name, args);
+    auto known = results.find(key);
+    if (known == results.end()) {
+        Result result;
+        uint64_t budget = std::min(steps_per_call, steps_left);
+        uint64_t steps = budget;
+        result.constant = interpreter.evaluate_call(name, args, &steps,
+                                                    &result.value);
+        steps_left -= budget - steps;
+        known = results.insert(std::make_pair(key, result)).first;
+    }
+    if (!known->second.constant) return false;
+    *value = known->second.value;
+    count_folded();
+    return true;
+}
+
+ExprAST *ConstantFolder::make_number(int64_t value) {
+    return arena->make<NumberAST>(value);
+}
+
+void ConstantFolder::fold_body(const ArenaArray<StatementAST*> &body) {
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        *iter = (*iter)->fold(this);
+    }
+}
+
+size_t fold_constants(const std::vector<FunctionAST*> &functions,
+                      Arena *arena, const Options &options) {
+    ConstantFolder folder(functions, arena, options);
+    for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+        (*iter)->fold(&folder);
+    }
+    return folder.folded_count();
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_FOLD_H_
+#define LENS_FOLD_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "src/arena.h"
+#include "src/ast.h"
+#include "src/effects.h"
+#include "src/interpreter.h"
+#include "src/symbol.h"
+
+struct Options;
+
+// Simplifies the AST before code is generated from it, so there's less IR
+// for LLVM to build and optimize. Arithmetic on constants is worked out,
+// identities like x * 1 and x - x are removed, chains like (x + 1) + 2 are
+// combined, and multiplying by a power of two becomes a shift.
+//
+// Calls to pure functions with constant arguments are evaluated too, and a
+// NumberAST put in place of each one. Pure functions are found by a
+// CallGraph (src/effects.h). The calls are run in an Interpreter, and each
+// one gives up after making --eval-steps calls, so a call that never
+// finishes can't hang the compiler. One expensive call doesn't use up the
+// budget of the ones after it, but they all stop once they've made
+// --eval-total calls between them, to bound the time it all takes.
+//
+// The statements and expressions fold themselves, and ask the folder to
+// evaluate their calls and make their new nodes.
+class ConstantFolder {
+    struct Result {
+        // False if the call couldn't be evaluated
+        bool constant;
+        int64_t value;
+    };
+    // The new NumberASTs go in here
+    Arena *arena;
+    Interpreter interpreter;
+    CallGraph graph;
+    // Every call evaluated so far, including the ones that gave up
+    std::map<std::pair<Symbol, std::vector<int64_t>>, Result> results;
+    uint64_t steps_per_call;
+    uint64_t steps_left;
+    // Calls and other expressions replaced so far
+    size_t folded;
+
+ public:
+    ConstantFolder(const std::vector<FunctionAST*> &program, Arena *arena,
+                   const Options &options);
+
+    // Returns true and sets `value` if calling `name` on `args` always
+    // gives the same result, and it can be worked out within the budget
+    bool evaluate_call(Symbol name, const std::vector<int64_t> &args,
+                       int64_t *value);
+    ExprAST *make_number(int64_t value);
+    // Folds each statement of `body`, replacing it with its folded version
+    void fold_body(const ArenaArray<StatementAST*> &body);
+    // Called for each expression that's simplified
+    void count_folded() { folded++; }
+    size_t folded_count() const { return folded; }
+};
+
+// Folds all of `functions`, allocating new nodes in `arena`. Returns how
+// many expressions were replaced or simplified.
+size_t fold_constants(const std::vector<FunctionAST*> &functions,
+                      Arena *arena, const Options &options);
+
+#endif  // LENS_FOLD_H_
@@ -0,0 +1,295 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/interpreter.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+#include "src/arith.h"
+#include "src/jit.h"
+#include "src/lazy_jit.h"
+#include "src/options.h"
+#include "src/tokenizer.h"
+
+// Evaluating calls while compiling recurses on the compiler's own stack, so
+// it gives up well before that could run out
+static const size_t kMaxEvaluationDepth = 2000;
+
+// ========================================================================= //
+// Expressions
+// ========================================================================= //
+int64_t NumberAST::evaluate(Interpreter *interpreter) const {
+    return integer_value;
+}
+
+int64_t VariableAST::evaluate(Interpreter *interpreter) const {
+    return interpreter->lookup(name);
+}
+
+int64_t BinaryExprAST::evaluate(Interpreter *interpreter) const {
+    int64_t L = lhs->evaluate(interpreter);
+    int64_t R = rhs->evaluate(interpreter);
+    switch (op) {
+    case '+': return wrapping_add(L, R);
+    case '-': return wrapping_sub(L, R);
+    case '*': return wrapping_mul(L, R);
+    case '/':
+        if (R == 0) {
+            interpreter->error("division by zero");
+            return 0;
+        }
+        return wrapping_div(L, R);
+    case '<': return L < R;
+    case '>': return L > R;
+    case tokEq: return L == R;
+    case tokIneq: return L != R;
+    case OP_SHIFT_LEFT: return wrapping_shl(L, R);
+    default:
+        interpreter->error("invalid binary operator");
+        return 0;
+    }
+}
+
+int64_t CallAST::evaluate(Interpreter *interpreter) const {
+    size_t mark = interpreter->argument_mark();
+    for (auto iter = args.begin(); iter != args.end(); iter++) {
+        interpreter->push_argument((*iter)->evaluate(interpreter));
+    }
+    return interpreter->call(name, mark);
+}
+
+void CallAST::interpret_return(Interpreter *interpreter) const {
+    if (!interpreter->runs(name)) {
+        interpreter->return_value = evaluate(interpreter);
+        return;
+    }
+    for (auto iter = args.begin(); iter != args.end(); iter++) {
+        interpreter->push_argument((*iter)->evaluate(interpreter));
+    }
+    interpreter->tail_call();
+}
+
+// ========================================================================= //
+// Statements
+// ========================================================================= //
+bool AssignmentAST::interpret(Interpreter *interpreter) const {
+    interpreter->bind(name, rhs->evaluate(interpreter));
+    return false;
+}
+
+bool ReassignAST::interpret(Interpreter *interpreter) const {
+    interpreter->reassign(name, rhs->evaluate(interpreter));
+    return false;
+}
+
+bool ReturnAST::interpret(Interpreter *interpreter) const {
+    if (rvalue->type() == CALL_AST) {
+        static_cast<CallAST*>(rvalue)->interpret_return(interpreter);
+        return true;
+    }
+    interpreter->return_value = rvalue->evaluate(interpreter);
+    return true;
+}
+
+// Runs `body` until a statement in it returns
+static bool interpret_body(const ArenaArray<StatementAST*> &body,
+                           Interpreter *interpreter) {
+    for (auto iter = body.begin(); iter != body.end(); iter++) {
+        if ((*iter)->interpret(interpreter)) return true;
+    }
+    return false;
+}
+
+bool IfElseAST::interpret(Interpreter *interpreter) const {
+    bool taken = condition->evaluate(interpreter) != 0;
+    // Variables bound in a branch are scoped to it
+    size_t mark = interpreter->scope_mark();
+    bool returned = interpret_body(taken ? ifbody : elsebody, interpreter);
+    interpreter->pop_scope(mark);
+    return returned;
+}
+
+// ========================================================================= //
+// Interpreter
+// ========================================================================= //
+Interpreter::Interpreter(const std::vector<FunctionAST*> &program,
+                         const Options &options)
+    : frame(0), tier_up(options.tier_up), options(options), jit(NULL),
+      jit_failed(false), evaluating(false), failed(false), steps_left(0),
+      depth(0), unknown(), running(), tail_called(false), return_value(0) {
+    for (size_t i = 0; i < program.size(); i++) {
+        FunctionState function = {program[i], 0, NULL};
+        functions.push_back(function);
+        indices.insert(std::make_pair(program[i]->name(), i));
+        names.push_back(program[i]->name());
+        signatures[program[i]->name()] = program[i]->arg_count();
+    }
+    generate = [program](size_t i) { return program[i]->codegen() != NULL; };
+}
+
+Interpreter::~Interpreter() {
+    delete jit;
+}
+
+Interpreter::Binding *Interpreter::find(Symbol name) {
+    for (size_t i = bindings.size(); i > frame; i--) {
+        if (bindings[i - 1].name == name) return &bindings[i - 1];
+    }
+    error("Unknown variable name '%s'", Symbols().name(name).c_str());
+    return &unknown;
+}
+
+int64_t Interpreter::lookup(Symbol name) {
+    return find(name)->value;
+}
+
+void Interpreter::reassign(Symbol name, int64_t value) {
+    find(name)->value = value;
+}
+
+void Interpreter::compile(size_t index) {
+    if (jit == NULL) {
+        if (jit_failed) return;
+        jit = LazyJIT::create(names, signatures, generate, options);
+        if (jit == NULL) {
+            // Keep interpreting everything
+            jit_failed = true;
+            return;
+        }
+    }
+    functions[index].native =
+        reinterpret_cast<NativeFunction>(jit->compile_boxed(index));
+}
+
+void Interpreter::error(const char *format, ...) {
+    if (evaluating) {
+        failed = true;
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    printf("Runtime error: ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    // There's no way to carry on
+    exit(1);
+}
+
+bool Interpreter::take_step() {
+    if (!evaluating) return true;
+    if (!failed && (steps_left == 0 || depth == kMaxEvaluationDepth)) {
+        failed = true;
+    }
+    if (failed) return false;
+    steps_left--;
+    return true;
+}
+
+int64_t Interpreter::call(Symbol name, size_t mark) {
+    size_t arg_count = arguments.size() - mark;
+    if (!take_step()) {
+        arguments.resize(mark);
+        return 0;
+    }
+    auto index = indices.find(name);
+    if (index == indices.end()) {
+        if (name == SYM_PRINTI64 && arg_count == 1 && !evaluating) {
+            printf("%li\n", static_cast<long>(arguments[mark]));
+            arguments.resize(mark);
+            return 0;
+        }
+        error("unknown function '%s' referenced",
+              Symbols().name(name).c_str());
+        arguments.resize(mark);
+        return 0;
+    }
+    FunctionState &function = functions[index->second];
+    const ArenaArray<Symbol> &params = function.ast->params();
+    if (params.size() != arg_count) {
+        error("incorrect number of arguments (%s expected %li, %li given)",
+              Symbols().name(name).c_str(), params.size(), arg_count);
+        arguments.resize(mark);
+        return 0;
+    }
+
+    Symbol outer_running = running;
+    size_t outer_frame = frame;
+    running = name;
+    frame = bindings.size();
+    int64_t result = 0;
+    depth++;
+    // Each time round is a call, and a self tail call leaves the arguments
+    // for the next one at `mark`
+    for (bool first = true; ; first = false) {
+        if (!first && !take_step()) {
+            arguments.resize(mark);
+            break;
+        }
+        // Functions that fail to compile stay at `tier_up` calls, and
+        // aren't tried again
+        if (function.native == NULL && tier_up != 0 && !evaluating &&
+            ++function.calls == tier_up) {
+            compile(index->second);
+        }
+        if (function.native != NULL) {
+            result = function.native(arguments.data() + mark);
+            arguments.resize(mark);
+            break;
+        }
+
+        bindings.resize(frame);
+        for (size_t i = 0; i < arg_count; i++) {
+            bind(params[i], arguments[mark + i]);
+        }
+        arguments.resize(mark);
+        tail_called = false;
+        if (!interpret_body(function.ast->statements(), this)) break;
+        if (!tail_called) {
+            result = return_value;
+            break;
+        }
+    }
+    tail_called = false;
+    depth--;
+    bindings.resize(frame);
+    frame = outer_frame;
+    running = outer_running;
+    // main returns an i32
+    if (name == SYM_MAIN) result = static_cast<int32_t>(result);
+    return result;
+}
+
+bool Interpreter::evaluate_call(Symbol name, const std::vector<int64_t> &args,
+                                uint64_t *steps, int64_t *result) {
+    evaluating = true;
+    failed = false;
+    steps_left = *steps;
+    size_t mark = argument_mark();
+    arguments.insert(arguments.end(), args.begin(), args.end());
+    *result = call(name, mark);
+    *steps = steps_left;
+    evaluating = false;
+    return !failed;
+}
+
+size_t Interpreter::compiled() const {
+    return jit == NULL ? 0 : jit->compiled();
+}
+
+bool interpret_program(const std::vector<FunctionAST*> &functions,
+                       const Options &options, int *exit_code) {
+    Interpreter interpreter(functions, options);
+    if (!interpreter.has_main()) {
+        fprintf(stderr, "There's no top level code to run\n");
+        return false;
+    }
+    double run_time = run_main([&interpreter]() { return interpreter.run(); },
+                               exit_code);
+    if (options.time_phases) {
+        fprintf(stderr, "run       %10.3f ms (with %zu of %zu functions "
+                "compiled)\n", run_time, interpreter.compiled(),
+                interpreter.function_count());
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_INTERPRETER_H_
+#define LENS_INTERPRETER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "src/ast.h"
+#include "src/symbol.h"
+
+class LazyJIT;
+struct Options;
+
+// Runs a program by walking its AST, so it starts right away instead of
+// waiting for LLVM. Every function counts its calls, and once one has been
+// called `tier_up` times it's compiled with a LazyJIT, and its calls from
+// then on go to the machine code. The statements and expressions interpret
+// themselves, and use the interpreter for the variables in scope and calls.
+class Interpreter {
+    typedef int64_t (*NativeFunction)(const int64_t *args);
+    struct Binding {
+        Symbol name;
+        int64_t value;
+    };
+    struct FunctionState {
+        const FunctionAST *ast;
+        uint64_t calls;
+        // The boxed entry point once it's compiled
+        NativeFunction native;
+    };
+    std::vector<FunctionState> functions;
+    // The index of each function by name, the first one wins
+    std::map<Symbol, size_t> indices;
+    // The variables of every function being run. The current function's
+    // start at `frame`, and later bindings shadow earlier ones.
+    std::vector<Binding> bindings;
+    size_t frame;
+    // Arguments are evaluated onto here, see call
+    std::vector<int64_t> arguments;
+    // Calls before a function is compiled, or 0 to never compile
+    uint64_t tier_up;
+
+    // What the JIT needs, which is only made once something gets hot
+    std::vector<Symbol> names;
+    std::map<Symbol, size_t> signatures;
+    std::function<bool(size_t)> generate;
+    const Options &options;
+    LazyJIT *jit;
+    bool jit_failed;
+
+    // Set by evaluate_call. Instead of stopping the program, an error sets
+    // `failed`, and from then on every call returns 0 right away.
+    bool evaluating;
+    bool failed;
+    uint64_t steps_left;
+    // How many calls deep the interpreter is
+    size_t depth;
+    // What find returns for an unknown variable once `failed` is set
+    Binding unknown;
+
+    // The function being run, and whether its body ended in `return` of a
+    // call to itself, see interpret_return
+    Symbol running;
+    bool tail_called;
+
+    Binding *find(Symbol name);
+    void compile(size_t index);
+    // Takes a call off `steps_left` while evaluating. Returns false if the
+    // evaluation has failed, and the call should return 0 right away.
+    bool take_step();
+
+ public:
+    // Set by `return`
+    int64_t return_value;
+
+    Interpreter(const std::vector<FunctionAST*> &program,
+                const Options &options);
+    ~Interpreter();
+
+    // Makes a new variable in the current scope
+    void bind(Symbol name, int64_t value) {
+        bindings.push_back(Binding{name, value});
+    }
+    int64_t lookup(Symbol name);
+    void reassign(Symbol name, int64_t value);
+    // Variables bound after the mark go out of scope at pop_scope
+    size_t scope_mark() const { return bindings.size(); }
+    void pop_scope(size_t mark) { bindings.resize(mark); }
+
+    // Calls `name` with the arguments pushed since `mark`, and pops them
+    size_t argument_mark() const { return arguments.size(); }
+    void push_argument(int64_t value) { arguments.push_back(value); }
+    int64_t call(Symbol name, size_t mark);
+    // `return name(...)` from `name` itself pushes the arguments and calls
+    // this instead of call, and the running call loops with them, so it
+    // takes constant stack
+    bool runs(Symbol name) const { return running == name; }
+    void tail_call() { tail_called = true; }
+
+    // Stops the program with a message, see `evaluating`
+    void error(const char *format, ...);
+
+    // Runs `name` on `args` while compiling, see src/fold.h. Nothing gets
+    // compiled, and nothing may be printed. Gives up and returns false if
+    // it would take more than `steps` calls, recurse too deep, or stop the
+    // program with an error. The calls made are taken off `steps`.
+    bool evaluate_call(Symbol name, const std::vector<int64_t> &args,
+                       uint64_t *steps, int64_t *result);
+
+    // Whether the program has top level code, which run runs
+    bool has_main() const { return indices.count(SYM_MAIN) != 0; }
+    int run() { return call(SYM_MAIN, arguments.size()); }
+    // How many functions ended up compiled
+    size_t compiled() const;
+    size_t function_count() const { return indices.size(); }
+};
+
+// Runs the program with an Interpreter, putting what main returned in
+// `exit_code`. Returns false if there was nothing to run.
+bool interpret_program(const std::vector<FunctionAST*> &functions,
+                       const Options &options, int *exit_code);
+
+#endif  // LENS_INTERPRETER_H_
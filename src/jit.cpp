@@ -0,0 +1,84 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/jit.h"
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "src/object_cache.h"
+#include "src/options.h"
+#include "src/timer.h"
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/Support/TargetSelect.h"
+
+using namespace llvm;
+
+CodeGenOpt::Level codegen_opt_level(unsigned opt_level) {
+    switch (opt_level) {
+    case 0: return CodeGenOpt::None;
+    case 1: return CodeGenOpt::Less;
+    case 2: return CodeGenOpt::Default;
+    default: return CodeGenOpt::Aggressive;
+    }
+}
+
+double run_main(const std::function<int()> &lens_main, int *exit_code) {
+    // Lens code prints through C stdio, so get our own output out first
+    std::cout.flush();
+    Timer timer;
+    *exit_code = lens_main();
+    fflush(stdout);
+    return timer.milliseconds();
+}
+
+bool run_module(Module *module, const Options &options, int *exit_code) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    // Hashing the module for the cache is part of the cost of using it
+    Timer timer;
+    std::string error;
+    ExecutionEngine *engine = EngineBuilder(module)
+        .setUseMCJIT(true)
+        .setErrorStr(&error)
+        .setOptLevel(codegen_opt_level(options.opt_level))
+        .create();
+    if (engine == NULL) {
+        fprintf(stderr, "Couldn't create the JIT: %s\n", error.c_str());
+        return false;
+    }
+    ObjectFileCache *cache = NULL;
+    if (options.use_cache) {
+        std::string directory = options.cache_dir.empty()
+            ? default_cache_directory() : options.cache_dir;
+        cache = new ObjectFileCache(directory, module, options.opt_level,
+                                    options.size_level);
+        engine->setObjectCache(cache);
+    }
+    // MCJIT compiles the whole module here (or loads it from the cache), and
+    // makes it executable
+    engine->finalizeObject();
+    uint64_t address = engine->getFunctionAddress("main");
+    double compile_time = timer.milliseconds();
+    if (address == 0) {
+        fprintf(stderr, "There's no top level code to run\n");
+        delete engine;
+        delete cache;
+        return false;
+    }
+
+    double run_time = run_main(reinterpret_cast<int (*)()>(address),
+                               exit_code);
+
+    if (options.time_phases) {
+        fprintf(stderr, "jit       %10.3f ms%s\n", compile_time,
+                cache != NULL && cache->hit ? " (cached)" : "");
+        fprintf(stderr, "run       %10.3f ms\n", run_time);
+    }
+    delete engine;
+    delete cache;
+    return true;
+}
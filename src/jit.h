@@ -0,0 +1,26 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_JIT_H_
+#define LENS_JIT_H_
+
+#include <functional>
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CodeGen.h"
+
+struct Options;
+
+// Compiles `module` to machine code in memory with MCJIT and calls its main
+// function, putting what it returned in `exit_code`. The JIT takes ownership
+// of the module. Returns false if there was nothing to run.
+bool run_module(llvm::Module *module, const Options &options, int *exit_code);
+
+// Runs a Lens program by calling `lens_main`, putting what it returned in
+// `exit_code`, and returns how many milliseconds it took. Every way of
+// running a program goes through here, so its output and ours come out in
+// order.
+double run_main(const std::function<int()> &lens_main, int *exit_code);
+
+// The machine code generator's equivalent of -O<opt_level>
+llvm::CodeGenOpt::Level codegen_opt_level(unsigned opt_level);
+
+#endif  // LENS_JIT_H_
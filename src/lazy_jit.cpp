@@ -0,0 +1,207 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/lazy_jit.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "src/codegen.h"
+#include "src/jit.h"
+#include "src/optimize.h"
+#include "src/options.h"
+#include "src/timer.h"
+
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/TargetSelect.h"
+
+using namespace llvm;
+
+// The JIT the stubs compile with. There's only one at a time.
+static LazyJIT *active_jit = NULL;
+
+// Called by the stubs as lens_compile. We're in the middle of running Lens
+// code, so there's no way to report an error but to stop.
+static void *compile_on_first_call(int64_t index) {
+    uint64_t address = active_jit->compile(index);
+    if (address == 0) {
+        fflush(stdout);
+        fprintf(stderr, "Couldn't compile %s\n",
+                Symbols().name(active_jit->name(index)).c_str());
+        exit(1);
+    }
+    return reinterpret_cast<void*>(address);
+}
+
+// Adds the slot and stub for function `index` to `module`
+static void generate_stub(Module *module, Function *compile, Symbol name,
+                          size_t arg_count, size_t index) {
+    FunctionType *type = function_type(name, arg_count);
+    Function *stub = Function::Create(type, Function::InternalLinkage,
+                                      Symbols().name(name) + ".stub",
+                                      module);
+    GlobalVariable *slot = new GlobalVariable(
+        *module, type->getPointerTo(), false, GlobalValue::ExternalLinkage,
+        stub, slot_name(name));
+
+    IRBuilder<> builder(BasicBlock::Create(module->getContext(), "entry",
+                                           stub));
+    Value *address = builder.CreateCall(compile, builder.getInt64(index));
+    Value *function = builder.CreateBitCast(address, type->getPointerTo());
+    builder.CreateStore(function, slot);
+    std::vector<Value*> args;
+    for (auto arg = stub->arg_begin(); arg != stub->arg_end(); arg++) {
+        args.push_back(arg);
+    }
+    CallInst *call = builder.CreateCall(function, args);
+    call->setTailCall();
+    builder.CreateRet(call);
+}
+
+// Adds `<function>.boxed(args: i64*) -> i64` next to `function`
+static void generate_boxed_entry(Module *module, Function *function) {
+    Type *i64 = Type::getInt64Ty(module->getContext());
+    std::vector<Type*> arg_types = {i64->getPointerTo()};
+    Function *boxed = Function::Create(
+        FunctionType::get(i64, arg_types, false), Function::ExternalLinkage,
+        function->getName() + ".boxed", module);
+
+    IRBuilder<> builder(BasicBlock::Create(module->getContext(), "entry",
+                                           boxed));
+    std::vector<Value*> args;
+    for (unsigned i = 0; i < function->arg_size(); i++) {
+        Value *arg = builder.CreateConstGEP1_32(boxed->arg_begin(), i);
+        args.push_back(builder.CreateLoad(arg));
+    }
+    Value *result = builder.CreateCall(function, args);
+    builder.CreateRet(builder.CreateSExt(result, i64));
+}
+
+LazyJIT::LazyJIT(const std::vector<Symbol> &names,
+                 const std::map<Symbol, size_t> &signatures,
+                 const std::function<bool(size_t)> &generate,
+                 const Options &options)
+    : engine(NULL), names(names), signatures(signatures),
+      generate(generate), opt_level(options.opt_level),
+      size_level(options.size_level), addresses(names.size(), 0),
+      compiled_count(0) {}
+
+LazyJIT *LazyJIT::create(const std::vector<Symbol> &names,
+                         const std::map<Symbol, size_t> &signatures,
+                         const std::function<bool(size_t)> &generate,
+                         const Options &options) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+    InitializeNativeTargetAsmParser();
+
+    Module *module = new Module("lazy", TheContext());
+    CodegenContext codegen(&TheContext(), module);
+    CodegenContext *previous = set_codegen_context(&codegen);
+    generate_prelude(module);
+    set_codegen_context(previous);
+
+    Type *address_type = Type::getInt8PtrTy(module->getContext());
+    std::vector<Type*> compile_args = {Type::getInt64Ty(module->getContext())};
+    Function *compile = cast<Function>(module->getOrInsertFunction(
+        "lens_compile", FunctionType::get(address_type, compile_args, false)));
+    for (size_t i = 0; i < names.size(); i++) {
+        // With more than one definition, the first one wins
+        if (module->getNamedGlobal(slot_name(names[i])) != NULL) continue;
+        generate_stub(module, compile, names[i],
+                      signatures.find(names[i])->second, i);
+    }
+    sys::DynamicLibrary::AddSymbol(
+        "lens_compile", reinterpret_cast<void*>(compile_on_first_call));
+
+    std::string error;
+    ExecutionEngine *engine = EngineBuilder(module)
+        .setUseMCJIT(true)
+        .setErrorStr(&error)
+        .setOptLevel(codegen_opt_level(options.opt_level))
+        .create();
+    if (engine == NULL) {
+        fprintf(stderr, "Couldn't create the JIT: %s\n", error.c_str());
+        return NULL;
+    }
+    // The slots have to be in memory before any function can use them
+    engine->finalizeObject();
+
+    LazyJIT *jit = new LazyJIT(names, signatures, generate, options);
+    jit->engine = engine;
+    active_jit = jit;
+    return jit;
+}
+
+LazyJIT::~LazyJIT() {
+    if (active_jit == this) active_jit = NULL;
+    delete engine;
+}
+
+uint64_t LazyJIT::compile(size_t index) {
+    if (addresses[index] != 0) return addresses[index];
+
+    const std::string &name = Symbols().name(names[index]);
+    Module *module = new Module(name, TheContext());
+    CodegenContext codegen(&TheContext(), module);
+    codegen.signatures = &signatures;
+    codegen.call_through_slots = true;
+    CodegenContext *previous = set_codegen_context(&codegen);
+    declare_prelude(module);
+    bool generated = generate(index);
+    set_codegen_context(previous);
+    if (!generated) {
+        delete module;
+        return 0;
+    }
+    generate_boxed_entry(module, module->getFunction(name));
+    optimize_module(module, opt_level, size_level);
+
+    engine->addModule(module);
+    uint64_t address = engine->getFunctionAddress(name);
+    engine->finalizeObject();
+    addresses[index] = address;
+    compiled_count++;
+    return address;
+}
+
+uint64_t LazyJIT::compile_boxed(size_t index) {
+    if (compile(index) == 0) return 0;
+    return engine->getFunctionAddress(Symbols().name(names[index]) +
+                                      ".boxed");
+}
+
+bool run_lazy(const std::vector<Symbol> &names,
+              const std::map<Symbol, size_t> &signatures,
+              const std::function<bool(size_t)> &generate,
+              const Options &options, int *exit_code) {
+    size_t main_index = names.size();
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == SYM_MAIN) main_index = i;
+    }
+    if (main_index == names.size()) {
+        fprintf(stderr, "There's no top level code to run\n");
+        return false;
+    }
+
+    Timer timer;
+    LazyJIT *jit = LazyJIT::create(names, signatures, generate, options);
+    if (jit == NULL) return false;
+    uint64_t address = jit->compile(main_index);
+    double compile_time = timer.milliseconds();
+    if (address == 0) {
+        delete jit;
+        return false;
+    }
+
+    double run_time = run_main(reinterpret_cast<int (*)()>(address),
+                               exit_code);
+
+    if (options.time_phases) {
+        fprintf(stderr, "jit       %10.3f ms (main only)\n", compile_time);
+        fprintf(stderr, "run       %10.3f ms (with %zu of %zu functions "
+                "compiled)\n", run_time, jit->compiled(), signatures.size());
+    }
+    delete jit;
+    return true;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_LAZY_JIT_H_
+#define LENS_LAZY_JIT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+
+#include "src/symbol.h"
+
+struct Options;
+
+// Compiles the functions of a program with MCJIT one at a time, only when
+// they're needed, so the time to get going depends on how much of the
+// program runs rather than on how big it is.
+//
+// The JIT starts out with a module that only has a slot for each function,
+// holding the address calls to it go to, and a stub. Every slot starts out
+// pointing at its function's stub. The stub compiles the function, stores
+// its address in the slot, and then calls on into it. Later calls load the
+// slot and go straight there. Functions are generated with
+// call_through_slots, so their calls all go through slots too.
+//
+// Each function is compiled with a boxed entry point as well, which takes
+// its arguments as an array, so C++ can call a function of any arity.
+class LazyJIT {
+    llvm::ExecutionEngine *engine;
+    const std::vector<Symbol> &names;
+    const std::map<Symbol, size_t> &signatures;
+    const std::function<bool(size_t)> &generate;
+    unsigned opt_level;
+    unsigned size_level;
+    // The address of each function, or 0 until it's compiled
+    std::vector<uint64_t> addresses;
+    size_t compiled_count;
+
+    LazyJIT(const std::vector<Symbol> &names,
+            const std::map<Symbol, size_t> &signatures,
+            const std::function<bool(size_t)> &generate,
+            const Options &options);
+
+ public:
+    // `names[i]` is the name of function i, `signatures` has the argument
+    // count of each, and generate(i) generates function i into TheModule().
+    // They have to outlive the JIT. Returns NULL if MCJIT can't be set up.
+    static LazyJIT *create(const std::vector<Symbol> &names,
+                           const std::map<Symbol, size_t> &signatures,
+                           const std::function<bool(size_t)> &generate,
+                           const Options &options);
+    ~LazyJIT();
+
+    // The address of function `index`, compiling it if it hasn't been yet,
+    // or 0 if it has errors
+    uint64_t compile(size_t index);
+    // Function `index`'s boxed entry point, an int64_t (*)(const int64_t*).
+    // main's result is sign extended.
+    uint64_t compile_boxed(size_t index);
+    Symbol name(size_t index) const { return names[index]; }
+    // How many functions have been compiled so far
+    size_t compiled() const { return compiled_count; }
+};
+
+// Runs a program's main function with a LazyJIT, putting what it returned in
+// `exit_code`. Returns false if there was nothing to run.
+bool run_lazy(const std::vector<Symbol> &names,
+              const std::map<Symbol, size_t> &signatures,
+              const std::function<bool(size_t)> &generate,
+              const Options &options, int *exit_code);
+
+#endif  // LENS_LAZY_JIT_H_
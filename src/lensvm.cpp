@@ -0,0 +1,42 @@
+// Copyright (c) 2015 Caleb Jones
+// lensvm runs bytecode written by `lensc --bytecode`. It doesn't link LLVM,
+// or even the rest of the compiler.
+#include <cstdio>
+#include <cstring>
+
+#include "src/bytecode.h"
+#include "src/timer.h"
+#include "src/vm.h"
+
+int main(int argc, char **argv) {
+    bool time_phases = false;
+    const char *filename = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--time") == 0) {
+            time_phases = true;
+        } else if (argv[i][0] != '-' && filename == NULL) {
+            filename = argv[i];
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+    if (filename == NULL) {
+        fprintf(stderr, "Usage: %s [--time] file.lbc\n", argv[0]);
+        return 1;
+    }
+
+    Timer timer;
+    BytecodeProgram program;
+    if (!read_bytecode(filename, &program)) return 1;
+    double load_time = timer.milliseconds();
+
+    timer.restart();
+    int exit_code;
+    if (!run_bytecode(program, &exit_code)) return 1;
+    if (time_phases) {
+        fprintf(stderr, "load      %10.3f ms\n", load_time);
+        fprintf(stderr, "run       %10.3f ms\n", timer.milliseconds());
+    }
+    return exit_code;
+}
@@ -1,73 +1,272 @@
 // Copyright (c) 2015 Caleb Jones
+#include <cstdio>
+#include <functional>
+#include <map>
 #include <string>
 #include <iostream>
+#include <memory>
+#include <set>
+#include <vector>
 
+#include "src/arena.h"
+#include "src/ast_bench.h"
+#include "src/bytecode_compiler.h"
+#include "src/codegen.h"
+#include "src/effects.h"
+#include "src/flat_ast.h"
+#include "src/fold.h"
+#include "src/interpreter.h"
+#include "src/jit.h"
+#include "src/lazy_jit.h"
+#include "src/native.h"
+#include "src/optimize.h"
+#include "src/options.h"
+#include "src/parallel_codegen.h"
+#include "src/parallel_parse.h"
 #include "src/parser.h"
 #include "src/tokenizer.h"
 #include "src/reader.h"
+#include "src/startup_bench.h"
+#include "src/timer.h"
+#include "src/token_buffer.h"
+#include "src/vm.h"
 #include "src/ast.h"
 
-#include "llvm/PassManager.h"
-#include "llvm/ExecutionEngine/ExecutionEngine.h"
-#include "llvm/Analysis/Passes.h"
-#include "llvm/IR/DataLayout.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/ExecutionEngine/Jit.h"
-
 using namespace llvm;
 
-ExecutionEngine *TheExecutionEngine;
+// Parses top level definitions until the end of the file or the first
+// error. Returns false if there was an error.
+static bool parse_file(Reader *reader, bool pre_lex, Arena *arena,
+                       std::vector<FunctionAST*> *functions) {
+    Tokenizer tokenizer(*reader);
+    TokenBuffer tokens;
+    if (pre_lex) tokens.lex(&tokenizer);
+    Parser parser = pre_lex ? Parser(tokens, arena) : Parser(tokenizer, arena);
+    while (FunctionAST *result = parser.parse_top_level()) {
+        functions->push_back(result);
+    }
+    // parse_top_level only stops early because of an error
+    return parser.next_token == tokEOF;
+}
 
-int main() {
-    // InitializeNativeTarget();
+// Each top level statement is parsed as a main function of its own. Join
+// them into one main, after all of the definitions so it can call any of
+// them.
+static void merge_top_level(std::vector<FunctionAST*> *functions,
+                            Arena *arena) {
+    std::vector<StatementAST*> statements;
+    size_t kept = 0;
+    for (size_t i = 0; i < functions->size(); i++) {
+        FunctionAST *function = (*functions)[i];
+        if (function->name() != SYM_MAIN) {
+            (*functions)[kept++] = function;
+            continue;
+        }
+        const ArenaArray<StatementAST*> &body = function->statements();
+        statements.insert(statements.end(), body.begin(), body.end());
+    }
+    functions->resize(kept);
+    if (statements.empty()) return;
+    PrototypeAST *proto = arena->make<PrototypeAST>(SYM_MAIN,
+                                                    ArenaArray<Symbol>());
+    functions->push_back(arena->make<FunctionAST>(
+        proto, arena->copy(statements.data(), statements.size())));
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
 
     auto module = TheModule();
     if (module == NULL) {
         std::cerr << "NO MODULE!" << std::endl;
     }
-    // TheExecutionEngine = EngineBuilder(module).create();
-    // if (TheExecutionEngine == NULL) {
-    //     std::cerr << "NO EXECUTION ENGINE!" << std::endl;
-    //     return 1;
-    // }
-
-    FunctionPassManager OurFPM(module);
-
-    // NOTE! This block taken almost directly from the kaleidescope tutorial
-
-    // Set up the optimizer pipeline.  Start with registering info about how the
-    // target lays out data structures.
-    // OurFPM.add(new DataLayout(*TheExecutionEngine->getDataLayout()));
-
-    // Provide basic AliasAnalysis support for GVN.
-    OurFPM.add(createBasicAliasAnalysisPass());
-    // Do simple "peephole" optimizations and bit-twiddling optzns.
-    OurFPM.add(createInstructionCombiningPass());
-    // Reassociate expressions.
-    OurFPM.add(createReassociatePass());
-    // Eliminate Common SubExpressions.
-    OurFPM.add(createGVNPass());
-    // Simplify the control flow graph (deleting unreachable blocks, etc).
-    OurFPM.add(createCFGSimplificationPass());
-    // Remove unneccesary stores
-    OurFPM.add(createDeadStoreEliminationPass());
-
-    OurFPM.doInitialization();
-
-    Reader reader("test.ls");
-    Tokenizer tokenizer(reader);
-    Parser parser(tokenizer);
-
-    while (true) {
-        FunctionAST *result = parser.parse_top_level();
-        if (result == NULL) break;
-
-        auto code = result->codegen();
-        if (code != NULL) {
-            OurFPM.run(*code);
+
+    Timer timer;
+    // The AST lives in these arenas until we're done compiling
+    std::vector<std::unique_ptr<Arena>> arenas;
+    std::vector<FunctionAST*> functions;
+    Reader reader(options.filename, options.read_mode);
+    // Parallel parsing needs the whole file in memory to split it up
+    if (options.jobs > 1 && reader.text() != NULL) {
+        if (!parse_parallel(reader.text(), reader.size(), options.jobs,
+                            options.pre_lex, &arenas, &functions)) {
+            return 1;
+        }
+    } else {
+        arenas.emplace_back(new Arena());
+        if (!parse_file(&reader, options.pre_lex, arenas.back().get(),
+                        &functions)) {
+            return 1;
+        }
+    }
+    arenas.emplace_back(new Arena());
+    merge_top_level(&functions, arenas.back().get());
+    if (options.memoize) mark_memoized(functions);
+    double parse_time = timer.milliseconds();
+
+    if (options.bench_ast) {
+        bench_ast(functions);
+        return 0;
+    }
+    if (options.bench_startup) {
+        bench_startup(functions, options);
+        return 0;
+    }
+    if (options.interpret) {
+        if (options.time_phases) {
+            fprintf(stderr, "parse     %10.3f ms\n", parse_time);
+        }
+        int exit_code;
+        if (!interpret_program(functions, options, &exit_code)) return 1;
+        return exit_code;
+    }
+
+    // The interpreter would spend about as long folding the program as it
+    // would running it, but everything else saves that time on every run
+    timer.restart();
+    size_t folded = fold_constants(functions, arenas.back().get(), options);
+    double fold_time = timer.milliseconds();
+
+    if (options.vm || options.emit == EMIT_BYTECODE) {
+        timer.restart();
+        BytecodeProgram program;
+        if (!compile_bytecode(functions, &program)) return 1;
+        if (options.time_phases) {
+            fprintf(stderr, "parse     %10.3f ms\n", parse_time);
+            fprintf(stderr, "fold      %10.3f ms (%zu folded)\n", fold_time,
+                    folded);
+            fprintf(stderr, "bytecode  %10.3f ms\n", timer.milliseconds());
+        }
+        if (options.emit == EMIT_BYTECODE) {
+            return write_bytecode(program, output_filename(options)) ? 0 : 1;
+        }
+        int exit_code;
+        if (!run_bytecode(program, &exit_code)) return 1;
+        return exit_code;
+    }
+
+    // Native code needs the target set on the module before any code is
+    // generated into it, so that parallel codegen can copy it
+    TargetMachine *machine = NULL;
+    if (!options.run && options.emit != EMIT_IR) {
+        machine = create_target_machine(module, options);
+        if (machine == NULL) return 1;
+    }
+
+    // Only print the AST and IR when that's the output
+    bool print_ir = !options.run && options.emit == EMIT_IR;
+    timer.restart();
+    FlatModule flat;
+    std::vector<Symbol> names;
+    std::map<Symbol, size_t> signatures;
+    std::function<void(size_t)> print;
+    std::function<bool(size_t)> generate;
+    if (options.flat_ast) {
+        for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+            (*iter)->flatten(&flat);
+        }
+        for (auto iter = flat.functions.begin(); iter != flat.functions.end();
+             iter++) {
+            names.push_back(iter->name);
+            signatures[iter->name] = iter->params.count;
+        }
+        print = [&](size_t i) { flat.print_function(&std::cout, i); };
+        generate = [&](size_t i) { return flat.function_codegen(i) != NULL; };
+    } else {
+        for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+            names.push_back((*iter)->name());
+            signatures[(*iter)->name()] = (*iter)->arg_count();
+        }
+        print = [&](size_t i) { std::cout << *functions[i]; };
+        generate = [&](size_t i) { return functions[i]->codegen() != NULL; };
+    }
+    size_t count = names.size();
+    // Functions can call functions defined after them
+    Codegen().signatures = &signatures;
+    std::set<Symbol> readnone = find_readnone(functions);
+    Codegen().readnone = &readnone;
+
+    if (options.lazy) {
+        if (options.time_phases) {
+            fprintf(stderr, "parse     %10.3f ms\n", parse_time);
+            fprintf(stderr, "fold      %10.3f ms (%zu folded)\n", fold_time,
+                    folded);
+        }
+        int exit_code;
+        if (!run_lazy(names, signatures, generate, options, &exit_code)) {
+            return 1;
+        }
+        return exit_code;
+    }
+
+    // In parallel, each batch is optimized along with its codegen
+    bool parallel = options.jobs > 1 && count > 1;
+    if (parallel) {
+        for (size_t i = 0; print_ir && i < count; i++) {
+            print(i);
+            std::cout << std::endl;
+        }
+        if (!parallel_codegen(module, count, options.jobs, signatures,
+                              &readnone, generate, options.opt_level,
+                              options.size_level)) {
+            return 1;
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            if (print_ir) {
+                print(i);
+                std::cout << std::endl;
+            }
+            generate(i);
         }
     }
+    double codegen_time = timer.milliseconds();
+
+    timer.restart();
+    // A program that's run or linked on its own is the whole program, so
+    // nothing outside the module calls anything but main. Objects and
+    // assembly are for linking with other code, which can call anything.
+    Function *entry = module->getFunction("main");
+    if ((options.run || options.emit == EMIT_EXECUTABLE) && entry != NULL &&
+        !entry->isDeclaration()) {
+        internalize_module(module);
+    }
+    if (parallel) {
+        optimize_linked(module, options.opt_level, options.size_level,
+                        machine);
+    } else {
+        optimize_module(module, options.opt_level, options.size_level,
+                        machine);
+    }
+    double optimize_time = timer.milliseconds();
 
+    if (options.time_phases) {
+        fprintf(stderr, "parse     %10.3f ms\n", parse_time);
+        fprintf(stderr, "fold      %10.3f ms (%zu folded)\n", fold_time,
+                folded);
+        fprintf(stderr, "codegen   %10.3f ms\n", codegen_time);
+        fprintf(stderr, "optimize  %10.3f ms (-O%c)\n", optimize_time,
+                opt_level_name(options));
+    }
+
+    if (options.run) {
+        int exit_code;
+        if (!run_module(module, options, &exit_code)) return 1;
+        return exit_code;
+    }
+    if (machine != NULL) {
+        timer.restart();
+        bool emitted = emit_native(module, machine, options);
+        if (options.time_phases) {
+            fprintf(stderr, "emit      %10.3f ms\n", timer.milliseconds());
+        }
+        delete machine;
+        return emitted ? 0 : 1;
+    }
     TheModule()->dump();
     return 0;
 }
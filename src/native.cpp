@@ -0,0 +1,141 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/native.h"
+
+#include <cstdio>
+#include <string>
+
+#include "src/jit.h"
+#include "src/options.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/PassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Target/TargetOptions.h"
+
+using namespace llvm;
+
+TargetMachine *create_target_machine(Module *module,
+                                     const Options &options) {
+    InitializeNativeTarget();
+    InitializeNativeTargetAsmPrinter();
+
+    std::string triple = sys::getProcessTriple();
+    std::string error;
+    const Target *target = TargetRegistry::lookupTarget(triple, error);
+    if (target == NULL) {
+        fprintf(stderr, "Can't generate code for %s: %s\n", triple.c_str(),
+                error.c_str());
+        return NULL;
+    }
+
+    std::string cpu = options.cpu;
+    SubtargetFeatures features;
+    if (cpu == "native") {
+        cpu = sys::getHostCPUName();
+        // Not every host can list its features. The CPU name implies them
+        // when it can't.
+        StringMap<bool> host_features;
+        if (sys::getHostCPUFeatures(host_features)) {
+            for (auto iter = host_features.begin();
+                 iter != host_features.end(); iter++) {
+                features.AddFeature(iter->getKey(), iter->getValue());
+            }
+        }
+    }
+
+    TargetOptions target_options;
+    TargetMachine *machine = target->createTargetMachine(
+        triple, cpu, features.getString(), target_options, Reloc::PIC_,
+        CodeModel::Default, codegen_opt_level(options.opt_level));
+    if (machine == NULL) {
+        fprintf(stderr, "Can't generate code for CPU '%s'\n", cpu.c_str());
+        return NULL;
+    }
+    module->setTargetTriple(triple);
+    module->setDataLayout(
+        machine->getDataLayout()->getStringRepresentation());
+    return machine;
+}
+
+// Runs the code generator over `module`, writing `type` to `path`
+static bool write_native(Module *module, TargetMachine *machine,
+                         TargetMachine::CodeGenFileType type,
+                         const std::string &path) {
+    std::string error;
+    sys::fs::OpenFlags flags = type == TargetMachine::CGFT_ObjectFile
+        ? sys::fs::F_Binary : sys::fs::F_None;
+    tool_output_file output(path.c_str(), error, flags);
+    if (!error.empty()) {
+        fprintf(stderr, "Can't write %s: %s\n", path.c_str(), error.c_str());
+        return false;
+    }
+
+    PassManager passes;
+    passes.add(new DataLayout(*machine->getDataLayout()));
+    machine->addAnalysisPasses(passes);
+    formatted_raw_ostream stream(output.os());
+    if (machine->addPassesToEmitFile(passes, stream, type)) {
+        fprintf(stderr, "The target can't write this kind of file\n");
+        return false;
+    }
+    passes.run(*module);
+    stream.flush();
+    // Otherwise the file is deleted when `output` is destroyed
+    output.keep();
+    return true;
+}
+
+// Links `object` into an executable at `path` with the system C compiler,
+// which knows where the C runtime and libc are
+static bool link_executable(const std::string &object,
+                            const std::string &path) {
+    std::string compiler = sys::FindProgramByName("cc");
+    if (compiler.empty()) {
+        fprintf(stderr, "Can't find cc to link with\n");
+        return false;
+    }
+    const char *args[] = {compiler.c_str(), object.c_str(), "-o",
+                          path.c_str(), NULL};
+    std::string error;
+    int status = sys::ExecuteAndWait(compiler, args, NULL, NULL, 0, 0,
+                                     &error);
+    if (status != 0) {
+        fprintf(stderr, "Linking failed%s%s\n", error.empty() ? "" : ": ",
+                error.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool emit_native(Module *module, TargetMachine *machine,
+                 const Options &options) {
+    std::string path = output_filename(options);
+    if (options.emit == EMIT_ASSEMBLY) {
+        return write_native(module, machine, TargetMachine::CGFT_AssemblyFile,
+                            path);
+    }
+    if (options.emit == EMIT_OBJECT) {
+        return write_native(module, machine, TargetMachine::CGFT_ObjectFile,
+                            path);
+    }
+
+    SmallString<128> object;
+    if (sys::fs::createTemporaryFile("lens", "o", object)) {
+        fprintf(stderr, "Can't create a temporary object file\n");
+        return false;
+    }
+    bool linked = write_native(module, machine,
+                               TargetMachine::CGFT_ObjectFile, object.str())
+                  && link_executable(object.str(), path);
+    sys::fs::remove(object.str());
+    return linked;
+}
@@ -0,0 +1,21 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_NATIVE_H_
+#define LENS_NATIVE_H_
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+struct Options;
+
+// Makes a TargetMachine for this machine's triple and options.cpu, and
+// points `module` at it so the optimizer can use what it knows about the
+// target. Prints an error and returns NULL if the target isn't available.
+llvm::TargetMachine *create_target_machine(llvm::Module *module,
+                                           const Options &options);
+
+// Writes `module` out as options.emit asks: an object file, assembly, or an
+// executable linked by the system C compiler. Returns false on failure.
+bool emit_native(llvm::Module *module, llvm::TargetMachine *machine,
+                 const Options &options);
+
+#endif  // LENS_NATIVE_H_
@@ -0,0 +1,90 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/object_cache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// Like mkdir -p. Returns false if the directory doesn't exist afterwards.
+static bool make_directories(const std::string &path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos;
+         slash = path.find('/', slash + 1)) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+std::string default_cache_directory() {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    if (xdg != NULL && xdg[0] != '\0') return std::string(xdg) + "/lens";
+    const char *home = getenv("HOME");
+    if (home != NULL && home[0] != '\0') {
+        return std::string(home) + "/.cache/lens";
+    }
+    return ".lens-cache";
+}
+
+ObjectFileCache::ObjectFileCache(const std::string &directory,
+                                 const Module *module, unsigned opt_level,
+                                 unsigned size_level)
+    : directory(directory), hit(false) {
+    std::string ir;
+    raw_string_ostream ir_stream(ir);
+    module->print(ir_stream, NULL);
+    ir_stream.flush();
+
+    // MCJIT compiles for the host when the module doesn't say otherwise
+    std::string triple = module->getTargetTriple();
+    if (triple.empty()) triple = sys::getProcessTriple();
+    char levels[16];
+    snprintf(levels, sizeof(levels), "O%u s%u", opt_level, size_level);
+
+    MD5 hash;
+    hash.update(ir);
+    hash.update(triple);
+    hash.update(levels);
+    MD5::MD5Result result;
+    hash.final(result);
+    SmallString<32> key;
+    MD5::stringifyResult(result, key);
+    object_path = directory + "/" + key.str().str() + ".o";
+}
+
+MemoryBuffer *ObjectFileCache::getObject(const Module *module) {
+    OwningPtr<MemoryBuffer> object;
+    // Large objects get mapped rather than read
+    if (MemoryBuffer::getFile(object_path, object, -1, false)) return NULL;
+    hit = true;
+    // MCJIT takes ownership of the buffer
+    return object.take();
+}
+
+void ObjectFileCache::notifyObjectCompiled(const Module *module,
+                                           const MemoryBuffer *object) {
+    if (!make_directories(directory)) return;
+    // Write to a temporary file and move it into place, so another lensc
+    // never sees half an object
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%ld", static_cast<long>(getpid()));
+    std::string temporary = object_path + suffix;
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == NULL) return;
+    size_t size = object->getBufferSize();
+    bool written = fwrite(object->getBufferStart(), 1, size, file) == size;
+    if (fclose(file) != 0) written = false;
+    if (!written || rename(temporary.c_str(), object_path.c_str()) != 0) {
+        remove(temporary.c_str());
+    }
+}
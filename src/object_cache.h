@@ -0,0 +1,35 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_OBJECT_CACHE_H_
+#define LENS_OBJECT_CACHE_H_
+
+#include <string>
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Keeps the object files MCJIT compiles in a directory, so running the same
+// program again can load its machine code instead of generating it. Objects
+// are keyed by a hash of the optimized IR, the target triple and the
+// optimization level, so any change to the program or the options misses.
+class ObjectFileCache : public llvm::ObjectCache {
+    std::string directory;
+    // Where the object for the module being compiled is, or would be
+    std::string object_path;
+
+ public:
+    // The key is computed from `module` now, so it must already be
+    // optimized
+    ObjectFileCache(const std::string &directory, const llvm::Module *module,
+                    unsigned opt_level, unsigned size_level);
+    virtual void notifyObjectCompiled(const llvm::Module *module,
+                                      const llvm::MemoryBuffer *object);
+    virtual llvm::MemoryBuffer *getObject(const llvm::Module *module);
+    // Whether getObject found a compiled object
+    bool hit;
+};
+
+// $XDG_CACHE_HOME/lens, or ~/.cache/lens
+std::string default_cache_directory();
+
+#endif  // LENS_OBJECT_CACHE_H_
@@ -0,0 +1,122 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/optimize.h"
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/PassManager.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Scalar.h"
+
+using namespace llvm;
+
+// Uses the same inlining thresholds as clang does for each level
+static Pass *create_inliner(unsigned opt_level, unsigned size_level) {
+    if (opt_level <= 1) return createAlwaysInlinerPass();
+    if (size_level > 0) return createFunctionInliningPass(75);
+    if (opt_level > 2) return createFunctionInliningPass(275);
+    return createFunctionInliningPass(225);
+}
+
+// Tells the passes in `passes` about the target
+static void add_target_passes(PassManagerBase *passes, Module *module,
+                              TargetMachine *machine) {
+    if (machine == NULL) {
+        if (!module->getDataLayout().empty()) {
+            passes->add(new DataLayout(module));
+        }
+        return;
+    }
+    passes->add(new DataLayout(*machine->getDataLayout()));
+    machine->addAnalysisPasses(*passes);
+}
+
+// PassManagerBuilder knows which passes belong at which level. From -O1 up
+// the module pipeline has IPSCCP, LICM, loop unrolling and tail call
+// elimination. -O2 adds GVN and GlobalDCE, and we turn on the vectorizers
+// there too.
+static void configure(PassManagerBuilder *builder, unsigned opt_level,
+                      unsigned size_level) {
+    builder->OptLevel = opt_level;
+    builder->SizeLevel = size_level;
+    builder->Inliner = create_inliner(opt_level, size_level);
+    builder->DisableUnrollLoops = opt_level == 0;
+    builder->LoopVectorize = opt_level > 1 && size_level == 0;
+    builder->SLPVectorize = opt_level > 1 && size_level == 0;
+}
+
+// Function passes only look at one function at a time, before the module
+// passes inline anything
+static void run_function_passes(Module *module, unsigned opt_level,
+                                unsigned size_level, TargetMachine *machine) {
+    PassManagerBuilder builder;
+    configure(&builder, opt_level, size_level);
+
+    FunctionPassManager function_passes(module);
+    add_target_passes(&function_passes, module, machine);
+    if (opt_level > 0) {
+        // Turn the stack slots of reassigned variables into registers
+        // before anything else looks at the function
+        function_passes.add(createPromoteMemoryToRegisterPass());
+    }
+    builder.populateFunctionPassManager(function_passes);
+
+    function_passes.doInitialization();
+    for (auto iter = module->begin(); iter != module->end(); iter++) {
+        function_passes.run(*iter);
+    }
+    function_passes.doFinalization();
+}
+
+static void run_module_passes(Module *module, unsigned opt_level,
+                              unsigned size_level, TargetMachine *machine) {
+    PassManagerBuilder builder;
+    configure(&builder, opt_level, size_level);
+
+    PassManager module_passes;
+    add_target_passes(&module_passes, module, machine);
+    builder.populateModulePassManager(module_passes);
+    module_passes.run(*module);
+}
+
+void optimize_module(Module *module, unsigned opt_level,
+                     unsigned size_level, TargetMachine *machine) {
+    run_function_passes(module, opt_level, size_level, machine);
+    run_module_passes(module, opt_level, size_level, machine);
+}
+
+void optimize_part(Module *module, unsigned opt_level, unsigned size_level) {
+    optimize_module(module, opt_level, size_level);
+}
+
+void optimize_linked(Module *module, unsigned opt_level, unsigned size_level,
+                     TargetMachine *machine) {
+    PassManager passes;
+    add_target_passes(&passes, module, machine);
+    passes.add(create_inliner(opt_level, size_level));
+    if (opt_level > 0) {
+        // These run on each function the inliner is done with, which is
+        // all that changed since optimize_part. Inlining a function into
+        // one it calls can leave a call to itself, which tail call
+        // elimination turns back into a loop once the CFG is simplified
+        // down to the call and its return.
+        passes.add(createCFGSimplificationPass());
+        passes.add(createTailCallEliminationPass());
+        passes.add(createInstructionCombiningPass());
+        passes.add(createCFGSimplificationPass());
+        passes.add(createEarlyCSEPass());
+        // Internal functions move to the fast calling convention
+        passes.add(createGlobalOptimizerPass());
+        passes.add(createGlobalDCEPass());
+    }
+    passes.run(*module);
+}
+
+void internalize_module(Module *module) {
+    for (auto function = module->begin(); function != module->end();
+         function++) {
+        if (function->isDeclaration() || function->getName() == "main") {
+            continue;
+        }
+        function->setLinkage(GlobalValue::InternalLinkage);
+    }
+}
@@ -0,0 +1,37 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_OPTIMIZE_H_
+#define LENS_OPTIMIZE_H_
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+
+// Runs the pipeline for -O<opt_level> (with size_level 1 for -Os) over each
+// function in `module`, then the interprocedural passes over all of it.
+// Higher levels inline more aggressively and add the loop passes and
+// vectorizers, spending compile time on faster code. With a `machine`, the
+// passes know the target's data layout and costs.
+void optimize_module(llvm::Module *module, unsigned opt_level,
+                     unsigned size_level,
+                     llvm::TargetMachine *machine = NULL);
+
+// For a program generated as separate parts (see src/parallel_codegen.h).
+// optimize_part runs the whole -O<opt_level> pipeline over one part, which
+// is independent of the others, so the parts can be optimized in parallel.
+// It only sees and inlines the functions in that part. Once the parts are
+// linked back together, optimize_linked inlines calls from one part into
+// another, cleans up the code that was inlined and drops what's unused.
+// Without a `machine`, the passes use the module's data layout.
+void optimize_part(llvm::Module *module, unsigned opt_level,
+                   unsigned size_level);
+void optimize_linked(llvm::Module *module, unsigned opt_level,
+                     unsigned size_level,
+                     llvm::TargetMachine *machine = NULL);
+
+// Gives every function defined in `module` but main internal linkage. Only
+// for a module holding the whole program, run or linked into an executable
+// on its own, where nothing outside it calls anything else. The module
+// passes can then drop functions that end up unused, and GlobalOpt moves
+// the rest to the fast calling convention.
+void internalize_module(llvm::Module *module);
+
+#endif  // LENS_OPTIMIZE_H_
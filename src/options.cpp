@@ -0,0 +1,194 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/options.h"
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "src/parallel.h"
+#include "src/reader.h"
+
+Options::Options()
+    : filename("test.ls"), read_mode(READ_MMAP), pre_lex(false), jobs(1),
+      flat_ast(false), bench_ast(false), bench_startup(false), opt_level(2),
+      size_level(0), time_phases(false), run(false), lazy(false),
+      interpret(false), tier_up(1000), vm(false), eval_steps(10000000),
+      eval_total(30000000), memoize(false), use_cache(true), emit(EMIT_IR),
+      cpu("native") {}
+
+void print_usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [options] [file]\n"
+            "Options:\n"
+            "  --stream    Read the source through a small fixed size buffer\n"
+            "              instead of mapping it, for very large inputs\n"
+            "  --pre-lex   Lex the whole file before parsing it\n"
+            "  -j[N]       Parse, generate and optimize code on N threads\n"
+            "              (all of the cores if N is left out)\n"
+            "  --flat-ast  Generate code from the flat AST\n"
+            "  --bench-ast Time code generation from the class hierarchy\n"
+            "              and from the flat AST, instead of compiling\n"
+            "  --bench-startup\n"
+            "              Time running the program with the interpreter\n"
+            "              and with each JIT, instead of compiling\n"
+            "  -O<level>   Optimization level: 0, 1, 2 (the default), 3,\n"
+            "              or s to optimize for size\n"
+            "  --time      Print how long each phase of compilation took\n"
+            "  --run       Compile the program in memory and run it\n"
+            "  --lazy      Like --run, but compile each function the first\n"
+            "              time it's called\n"
+            "  --interpret Run the program in the interpreter, compiling\n"
+            "              functions once they get hot\n"
+            "  --tier-up=N Calls before --interpret compiles a function\n"
+            "              (default 1000, 0 to never compile)\n"
+            "  --vm        Run the program's bytecode, without LLVM\n"
+            "  --eval-steps=N\n"
+            "              Calls that evaluating a pure call with constant\n"
+            "              arguments can make while compiling (default\n"
+            "              10000000, 0 to leave every call to run time)\n"
+            "  --eval-total=N\n"
+            "              Calls that evaluating all of them can make\n"
+            "              (default 30000000)\n"
+            "  --memoize   Remember the results of pure recursive functions,\n"
+            "              so each is only worked out once per argument\n"
+            "  --cache-dir=DIR\n"
+            "              Keep the machine code --run compiles in DIR\n"
+            "              (default $XDG_CACHE_HOME/lens or ~/.cache/lens)\n"
+            "  --no-cache  Always compile from scratch with --run\n"
+            "  -c          Write a native object file\n"
+            "  -S          Write native assembly\n"
+            "  --bytecode  Write bytecode for lensvm\n"
+            "  -o FILE     Write the output to FILE. Without -c or -S,\n"
+            "              link an executable with the system C compiler\n"
+            "  -mcpu=NAME  Generate code for the NAME CPU (default native)\n",
+            program);
+}
+
+bool parse_options(int argc, char **argv, Options *options) {
+    bool have_filename = false;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--stream") == 0) {
+            options->read_mode = READ_RING;
+        } else if (strcmp(arg, "--pre-lex") == 0) {
+            options->pre_lex = true;
+        } else if (strcmp(arg, "--flat-ast") == 0) {
+            options->flat_ast = true;
+        } else if (strcmp(arg, "--bench-ast") == 0) {
+            options->bench_ast = true;
+        } else if (strcmp(arg, "--bench-startup") == 0) {
+            options->bench_startup = true;
+        } else if (strcmp(arg, "--run") == 0) {
+            options->run = true;
+        } else if (strcmp(arg, "--lazy") == 0) {
+            options->run = true;
+            options->lazy = true;
+        } else if (strcmp(arg, "--interpret") == 0) {
+            options->interpret = true;
+        } else if (strncmp(arg, "--tier-up=", 10) == 0) {
+            char *end;
+            options->tier_up = strtoul(arg + 10, &end, 10);
+            if (arg[10] == '\0' || *end != '\0') {
+                fprintf(stderr, "Bad call count '%s'\n", arg + 10);
+                return false;
+            }
+        } else if (strncmp(arg, "--eval-steps=", 13) == 0) {
+            char *end;
+            options->eval_steps = strtoul(arg + 13, &end, 10);
+            if (arg[13] == '\0' || *end != '\0') {
+                fprintf(stderr, "Bad step count '%s'\n", arg + 13);
+                return false;
+            }
+        } else if (strncmp(arg, "--eval-total=", 13) == 0) {
+            char *end;
+            options->eval_total = strtoul(arg + 13, &end, 10);
+            if (arg[13] == '\0' || *end != '\0') {
+                fprintf(stderr, "Bad step count '%s'\n", arg + 13);
+                return false;
+            }
+        } else if (strcmp(arg, "--memoize") == 0) {
+            options->memoize = true;
+        } else if (strncmp(arg, "--cache-dir=", 12) == 0) {
+            options->cache_dir = arg + 12;
+        } else if (strcmp(arg, "--no-cache") == 0) {
+            options->use_cache = false;
+        } else if (strcmp(arg, "-c") == 0) {
+            options->emit = EMIT_OBJECT;
+        } else if (strcmp(arg, "-S") == 0) {
+            options->emit = EMIT_ASSEMBLY;
+        } else if (strcmp(arg, "--bytecode") == 0) {
+            options->emit = EMIT_BYTECODE;
+        } else if (strcmp(arg, "--vm") == 0) {
+            options->vm = true;
+        } else if (strcmp(arg, "-o") == 0) {
+            if (i + 1 == argc) {
+                fprintf(stderr, "Missing file name after '-o'\n");
+                return false;
+            }
+            options->output = argv[++i];
+        } else if (strncmp(arg, "-mcpu=", 6) == 0) {
+            options->cpu = arg + 6;
+        } else if (strcmp(arg, "--time") == 0) {
+            options->time_phases = true;
+        } else if (strcmp(arg, "-Os") == 0) {
+            options->opt_level = 2;
+            options->size_level = 1;
+        } else if (strncmp(arg, "-O", 2) == 0) {
+            if (arg[2] < '0' || arg[2] > '3' || arg[3] != '\0') {
+                fprintf(stderr, "Bad optimization level '%s'\n", arg + 2);
+                return false;
+            }
+            options->opt_level = arg[2] - '0';
+            options->size_level = 0;
+        } else if (strncmp(arg, "-j", 2) == 0) {
+            if (arg[2] == '\0') {
+                options->jobs = hardware_threads();
+            } else {
+                char *end;
+                unsigned long jobs = strtoul(arg + 2, &end, 10);
+                // strtoul takes "-1" as ULONG_MAX, so bound it too
+                if (*end != '\0' || jobs == 0 || jobs > UINT_MAX) {
+                    fprintf(stderr, "Bad thread count '%s'\n", arg + 2);
+                    return false;
+                }
+                options->jobs = jobs;
+            }
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            fprintf(stderr, "Unknown option '%s'\n", arg);
+            return false;
+        } else if (have_filename) {
+            fprintf(stderr, "Only one input file is supported\n");
+            return false;
+        } else {
+            options->filename = arg;
+            have_filename = true;
+        }
+    }
+    // -o on its own asks for an executable
+    if (options->emit == EMIT_IR && !options->output.empty()) {
+        options->emit = EMIT_EXECUTABLE;
+    }
+    return true;
+}
+
+char opt_level_name(const Options &options) {
+    return options.size_level > 0 ? 's' : '0' + options.opt_level;
+}
+
+std::string output_filename(const Options &options) {
+    if (!options.output.empty()) return options.output;
+    // Replace the extension of the input, in the current directory
+    std::string name = options.filename;
+    size_t slash = name.rfind('/');
+    if (slash != std::string::npos) name = name.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    if (dot != std::string::npos && dot > 0) name = name.substr(0, dot);
+    switch (options.emit) {
+    case EMIT_ASSEMBLY: return name + ".s";
+    case EMIT_OBJECT: return name + ".o";
+    case EMIT_BYTECODE: return name + ".lbc";
+    default: return "a.out";
+    }
+}
@@ -0,0 +1,78 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_OPTIONS_H_
+#define LENS_OPTIONS_H_
+
+#include <string>
+
+// What the compiler produces
+enum EMIT_MODES {
+    // Print the AST and the IR
+    EMIT_IR,
+    // -S: native assembly
+    EMIT_ASSEMBLY,
+    // -c: a relocatable object file
+    EMIT_OBJECT,
+    // -o without -c or -S: an object linked into an executable
+    EMIT_EXECUTABLE,
+    // --bytecode: bytecode for lensvm
+    EMIT_BYTECODE
+};
+
+// Settings for a single run of the compiler, filled in from the command line
+struct Options {
+    std::string filename;
+    // One of READ_MODES, picks how the Reader gets at the source file
+    int read_mode;
+    // Lex the whole file into a TokenBuffer before parsing
+    bool pre_lex;
+    // How many threads to parse and generate code with
+    unsigned jobs;
+    // Generate code from a FlatModule instead of the class hierarchy
+    bool flat_ast;
+    // Time code generation with both ASTs instead of compiling
+    bool bench_ast;
+    // Time how long each way of running the program takes to finish
+    bool bench_startup;
+    // -O0 to -O3, and -Os (opt_level 2 with size_level 1)
+    unsigned opt_level;
+    unsigned size_level;
+    // Print how long each phase of compilation took
+    bool time_phases;
+    // JIT compile the program and run it, instead of printing its IR
+    bool run;
+    // With run, compile each function only when it's first called
+    bool lazy;
+    // Run the program in the interpreter, compiling a function once it's
+    // been called tier_up times (never if it's 0)
+    bool interpret;
+    unsigned tier_up;
+    // Run the program's bytecode in the VM
+    bool vm;
+    // How many calls compile time evaluation of a constant call can make,
+    // and how many all of them together can, see src/fold.h. 0 turns it
+    // off.
+    unsigned long eval_steps;
+    unsigned long eval_total;
+    // Give pure recursive functions a memo table
+    bool memoize;
+    // Where --run keeps compiled objects, or empty for the default place
+    std::string cache_dir;
+    bool use_cache;
+    // One of EMIT_MODES
+    int emit;
+    // Where to write the output, or empty to name it after the input
+    std::string output;
+    // The CPU to generate native code for, "native" for this machine's
+    std::string cpu;
+    Options();
+};
+
+// Returns false if the arguments couldn't be understood
+bool parse_options(int argc, char **argv, Options *options);
+// The file to write the output to, from -o or the name of the input
+std::string output_filename(const Options &options);
+// What goes after -O for the optimization level: '0' to '3', or 's'
+char opt_level_name(const Options &options);
+void print_usage(const char *program);
+
+#endif  // LENS_OPTIONS_H_
@@ -0,0 +1,35 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/parallel.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+void parallel_for(size_t count, unsigned threads,
+                  const std::function<void(size_t)> &body) {
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        while (true) {
+            size_t index = next++;
+            if (index >= count) return;
+            body(index);
+        }
+    };
+    // No point starting more threads than there is work
+    if (threads > count) threads = count;
+    std::vector<std::thread> pool;
+    for (unsigned i = 1; i < threads; i++) {
+        pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &thread : pool) {
+        thread.join();
+    }
+}
+
+unsigned hardware_threads() {
+    unsigned count = std::thread::hardware_concurrency();
+    // hardware_concurrency is allowed to return 0 if it doesn't know
+    return count == 0 ? 1 : count;
+}
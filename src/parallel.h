@@ -0,0 +1,17 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_PARALLEL_H_
+#define LENS_PARALLEL_H_
+
+#include <cstddef>
+#include <functional>
+
+// Calls body(i) for every i in [0, count), spread over `threads` threads
+// (the calling thread included). Indices are handed out one at a time, so
+// uneven work balances itself. Returns once every call has finished.
+void parallel_for(size_t count, unsigned threads,
+                  const std::function<void(size_t)> &body);
+
+// The number of threads to use when the user asks for "all of them"
+unsigned hardware_threads();
+
+#endif  // LENS_PARALLEL_H_
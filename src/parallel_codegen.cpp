@@ -0,0 +1,125 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/parallel_codegen.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "src/codegen.h"
+#include "src/optimize.h"
+#include "src/parallel.h"
+
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// More batches than threads, so a thread that gets a batch of small
+// functions can pick up another one
+static const size_t kBatchesPerThread = 4;
+
+struct Batch {
+    size_t first, end;
+    std::string bitcode;
+};
+
+// Codegen stops in the middle of a function that has an error, leaving
+// blocks without terminators. Turn those back into declarations so the
+// module can still be written out.
+static void drop_broken_functions(Module *module) {
+    for (auto function = module->begin(); function != module->end();
+         function++) {
+        for (auto block = function->begin(); block != function->end();
+             block++) {
+            if (block->getTerminator() == NULL) {
+                function->deleteBody();
+                break;
+            }
+        }
+    }
+}
+
+static void generate_batch(Batch *batch, const std::string &triple,
+                           const std::string &data_layout,
+                           const std::map<Symbol, size_t> &signatures,
+                           const std::set<Symbol> *readnone,
+                           const std::function<bool(size_t)> &generate,
+                           unsigned opt_level, unsigned size_level) {
+    LLVMContext context;
+    std::unique_ptr<Module> module(new Module("batch", context));
+    module->setTargetTriple(triple);
+    module->setDataLayout(data_layout);
+
+    CodegenContext codegen(&context, module.get());
+    codegen.signatures = &signatures;
+    codegen.readnone = readnone;
+    CodegenContext *previous = set_codegen_context(&codegen);
+    declare_prelude(module.get());
+    bool failed = false;
+    for (size_t i = batch->first; i < batch->end; i++) {
+        if (!generate(i)) failed = true;
+    }
+    set_codegen_context(previous);
+    if (failed) drop_broken_functions(module.get());
+
+    optimize_part(module.get(), opt_level, size_level);
+
+    raw_string_ostream out(batch->bitcode);
+    WriteBitcodeToFile(module.get(), out);
+    out.flush();
+}
+
+bool parallel_codegen(Module *module, size_t count, unsigned threads,
+                      const std::map<Symbol, size_t> &signatures,
+                      const std::set<Symbol> *readnone,
+                      const std::function<bool(size_t)> &generate,
+                      unsigned opt_level, unsigned size_level) {
+    // Turns on the locks around LLVM's own global state
+    llvm_start_multithreaded();
+
+    size_t batch_count = std::min(count, threads * kBatchesPerThread);
+    std::vector<Batch> batches(batch_count);
+    for (size_t i = 0; i < batch_count; i++) {
+        batches[i].first = count * i / batch_count;
+        batches[i].end = count * (i + 1) / batch_count;
+    }
+
+    const std::string triple = module->getTargetTriple();
+    const std::string data_layout = module->getDataLayout();
+    parallel_for(batch_count, threads, [&](size_t i) {
+        generate_batch(&batches[i], triple, data_layout, signatures,
+                       readnone, generate, opt_level, size_level);
+    });
+
+    // Linking is in order, so the functions stay in the order they were
+    // defined in
+    for (auto batch = batches.begin(); batch != batches.end(); batch++) {
+        std::unique_ptr<MemoryBuffer> buffer(
+            MemoryBuffer::getMemBuffer(batch->bitcode, "batch"));
+        std::string error;
+        Module *part = ParseBitcodeFile(buffer.get(), module->getContext(),
+                                        &error);
+        if (part == NULL) {
+            fprintf(stderr, "Couldn't read generated code: %s\n",
+                    error.c_str());
+            return false;
+        }
+        bool failed = Linker::LinkModules(module, part, Linker::DestroySource,
+                                          &error);
+        delete part;
+        if (failed) {
+            fprintf(stderr, "Couldn't link generated code: %s\n",
+                    error.c_str());
+            return false;
+        }
+        std::string().swap(batch->bitcode);
+    }
+    return true;
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_PARALLEL_CODEGEN_H_
+#define LENS_PARALLEL_CODEGEN_H_
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <set>
+
+#include "llvm/IR/Module.h"
+
+#include "src/symbol.h"
+
+// Generates the functions [0, count) of a program into `module` on `threads`
+// threads. The functions are split into batches, and each batch gets a
+// CodegenContext with its own LLVMContext and module. generate(i) is called
+// for each function in the batch, then the batch's module is optimized with
+// optimize_part (src/optimize.h). Calls to functions in other batches
+// go to declarations made from `signatures`, marked readnone if they're in
+// `readnone` (which may be NULL). Finally the batches are moved over to
+// `module`'s context as bitcode and linked into it, which resolves those
+// declarations. optimize_linked is left to the caller.
+//
+// Returns false if linking fails. Functions that failed to generate have
+// already printed an error, and are left as declarations.
+bool parallel_codegen(llvm::Module *module, size_t count, unsigned threads,
+                      const std::map<Symbol, size_t> &signatures,
+                      const std::set<Symbol> *readnone,
+                      const std::function<bool(size_t)> &generate,
+                      unsigned opt_level, unsigned size_level);
+
+#endif  // LENS_PARALLEL_CODEGEN_H_
@@ -0,0 +1,110 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/parallel_parse.h"
+
+#include <cctype>
+#include <cstring>
+#include <vector>
+
+#include "src/arena.h"
+#include "src/parallel.h"
+#include "src/parser.h"
+#include "src/reader.h"
+#include "src/token_buffer.h"
+#include "src/tokenizer.h"
+
+// A run of whole top level definitions, [begin, end) in the file
+struct Chunk {
+    size_t begin;
+    size_t end;
+    int first_line;
+};
+
+// How many chunks to aim for per thread, so that one long definition
+// doesn't leave the other threads idle
+static const unsigned kChunksPerThread = 8;
+
+static bool starts_with_word(const char *text, const char *end,
+                             const char *word) {
+    size_t length = strlen(word);
+    if (static_cast<size_t>(end - text) < length) return false;
+    if (memcmp(text, word, length) != 0) return false;
+    if (text + length == end) return true;
+    char next = text[length];
+    return !(isalnum(next) || next == '_');
+}
+
+// Whether a new top level definition can start on this line
+static bool starts_definition(const char *line, const char *end) {
+    if (line == end) return false;
+    // Indented lines, blank lines and comments belong to what's above them
+    if (isspace(*line) || *line == '#') return false;
+    // So do the rest of top level if statements
+    return !starts_with_word(line, end, "else") &&
+           !starts_with_word(line, end, "elif");
+}
+
+static std::vector<Chunk> split_chunks(const char *text, size_t size,
+                                       size_t target_size) {
+    std::vector<Chunk> chunks;
+    Chunk current = {0, 0, 1};
+    const char *end = text + size;
+    const char *line = text;
+    int line_number = 1;
+    while (line < end) {
+        size_t offset = line - text;
+        if (offset - current.begin >= target_size &&
+            starts_definition(line, end)) {
+            current.end = offset;
+            chunks.push_back(current);
+            current.begin = offset;
+            current.first_line = line_number;
+        }
+        const char *newline = static_cast<const char*>(
+            memchr(line, '\n', end - line));
+        if (newline == NULL) break;
+        line = newline + 1;
+        line_number++;
+    }
+    current.end = size;
+    chunks.push_back(current);
+    return chunks;
+}
+
+bool parse_parallel(const char *text, size_t size, unsigned threads,
+                    bool pre_lex, std::vector<std::unique_ptr<Arena>> *arenas,
+                    std::vector<FunctionAST*> *functions) {
+    size_t target_size = size / (threads * kChunksPerThread) + 1;
+    std::vector<Chunk> chunks = split_chunks(text, size, target_size);
+
+    // Each chunk allocates from its own arena, so they don't contend
+    size_t first_arena = arenas->size();
+    for (size_t i = 0; i < chunks.size(); i++) {
+        arenas->emplace_back(new Arena());
+    }
+    std::vector<std::vector<FunctionAST*>> results(chunks.size());
+    // Not vector<bool>, different threads write neighbouring elements
+    std::vector<char> succeeded(chunks.size());
+    parallel_for(chunks.size(), threads, [&](size_t i) {
+        const Chunk &chunk = chunks[i];
+        Reader reader(text + chunk.begin, chunk.end - chunk.begin,
+                      chunk.begin, chunk.first_line);
+        Tokenizer tokenizer(reader);
+        TokenBuffer tokens;
+        if (pre_lex) tokens.lex(&tokenizer);
+        Arena *arena = (*arenas)[first_arena + i].get();
+        Parser parser = pre_lex ? Parser(tokens, arena)
+                                : Parser(tokenizer, arena);
+        while (FunctionAST *result = parser.parse_top_level()) {
+            results[i].push_back(result);
+        }
+        // parse_top_level only stops early because of an error
+        succeeded[i] = (parser.next_token == tokEOF);
+    });
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        functions->insert(functions->end(), results[i].begin(),
+                          results[i].end());
+        if (!succeeded[i]) return false;
+    }
+    return true;
+}
@@ -0,0 +1,22 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_PARALLEL_PARSE_H_
+#define LENS_PARALLEL_PARSE_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+class Arena;
+class FunctionAST;
+
+// Parses a file that's already in memory by splitting it at the top level
+// definitions (lines with no indentation) and giving each chunk its own
+// Tokenizer, Parser and Arena on one of `threads` threads. `functions` gets
+// the results in source order, up to the first chunk that failed to parse,
+// and `arenas` gets the Arenas that own them. Returns false if there was a
+// parse error.
+bool parse_parallel(const char *text, size_t size, unsigned threads,
+                    bool pre_lex, std::vector<std::unique_ptr<Arena>> *arenas,
+                    std::vector<FunctionAST*> *functions);
+
+#endif  // LENS_PARALLEL_PARSE_H_
@@ -8,117 +8,236 @@
 #include "src/ast.h"
 #include "src/tokenizer.h"
 #include "src/reader.h"
+#include "src/table.h"
+#include "src/token_buffer.h"
 
 #define ERROR(msg, ...) (printf("Error at line %d column %d: " msg "\n", \
-tokenizer.line->line_number, tokenizer.col, ##__VA_ARGS__), nullptr)
-
-Parser::Parser(Tokenizer &tok) : tokenizer(tok) {
-    operator_precedence['+'] = 20;
-    operator_precedence['-'] = 20;
-    operator_precedence['*'] = 40;
-    operator_precedence['/'] = 40;
-    operator_precedence['<'] = 10;
-    operator_precedence['>'] = 10;
-    operator_precedence[tokEq] = 10;
-    operator_precedence[tokIneq] = 10;
-    operator_precedence['='] = 1;
+error_line(), error_col(), ##__VA_ARGS__), nullptr)
+
+Parser::Parser(Tokenizer &tok, Arena *arena)
+    : tokenizer(&tok), tokens(NULL), arena(arena) {
     get_next_token();  // Prime the token pump!
 }
 
+Parser::Parser(TokenBuffer &tok, Arena *arena)
+    : tokenizer(NULL), tokens(&tok), token_index(0), arena(arena) {
+    next_token = tokens->kinds[0];
+}
+
+// ========================================================================= //
+// Operator precedence
+// ========================================================================= //
+struct OperatorInfo {
+    // 0 for tokens that aren't binary operators
+    int precedence;
+    bool right_associative;
+};
+
+constexpr OperatorInfo operator_info(int token) {
+    return (token == '*' || token == '/') ? OperatorInfo{40, false}
+         : (token == '+' || token == '-') ? OperatorInfo{20, false}
+         : (token == '<' || token == '>' || token == tokEq ||
+            token == tokIneq) ? OperatorInfo{10, false}
+         : token == '=' ? OperatorInfo{1, false}
+         : OperatorInfo{0, false};
+}
+
+// Every token except tokInvalid fits in the table
+static constexpr int kOperatorTableSize = 320;
+static_assert(tokType < kOperatorTableSize,
+              "operator_table is too small for the Tokens enum");
+static constexpr OperatorInfo operator_table[kOperatorTableSize] = {
+    TABLE256(operator_info), TABLE64(operator_info, 256) };
+
+static inline OperatorInfo operator_of(int token) {
+    // tokInvalid wraps around to a huge index, and isn't an operator
+    if (static_cast<unsigned>(token) >= kOperatorTableSize) {
+        return OperatorInfo{0, false};
+    }
+    return operator_table[token];
+}
+
+int Parser::read_token() {
+    if (tokenizer != NULL) return tokenizer->get_token();
+    // Stay on the tokEOF at the end of the buffer
+    if (token_index + 1 < tokens->size()) token_index++;
+    return tokens->kinds[token_index];
+}
+
 int Parser::get_next_token() {
     auto value = next_token;
-    next_token = tokenizer.get_token();
+    next_token = read_token();
     // Don't submit duplicate newline tokens
     if (value == tokNewline) {
         while (next_token == tokNewline) {
-            next_token = tokenizer.get_token();
+            next_token = read_token();
         }
     }
     return value;
 }
 
-ExprAST *Parser::parse_number_expr() {
-    ExprAST *result = new NumberAST(tokenizer.number_value);
-    get_next_token();  // Consume the number
-    return result;
+Symbol Parser::identifier() const {
+    if (tokenizer != NULL) return tokenizer->identifier_symbol;
+    return tokens->payloads[token_index];
 }
 
-ExprAST *Parser::parse_paren_expr() {
-    get_next_token();  // Consume '('
-    ExprAST *inner = parse_expression();
-    if (inner == NULL) return NULL;
-
-    if (next_token != ')') {
-        return ERROR("expected ')'");
-    }
-    get_next_token();  // Consume ')'
-    return inner;
+const NumberLiteral &Parser::number() const {
+    if (tokenizer != NULL) return tokenizer->number;
+    return tokens->numbers[tokens->payloads[token_index]];
 }
 
-ExprAST *Parser::parse_identifer_expr() {
-    std::string identifier_name = tokenizer.identifier_string;
-    get_next_token();  // Consume identifier string
-
-    if (next_token != '(') return new VariableAST(identifier_name);
-    get_next_token();  // Consume '('
+const std::string &Parser::token_error() const {
+    if (tokenizer != NULL) return tokenizer->token_error;
+    return tokens->errors[tokens->payloads[token_index]];
+}
 
-    std::vector<ExprAST*> args;
-    if (next_token != ')') {
-        while (true) {
-            ExprAST *next_expr = parse_expression();
-            if (next_expr == NULL) return NULL;
-            args.push_back(next_expr);
+int Parser::error_line() const {
+    if (tokenizer != NULL) return tokenizer->line->line_number;
+    return tokens->lines[token_index];
+}
 
-            // We're done with the argument list
-            if (next_token == ')') break;
+int Parser::error_col() const {
+    if (tokenizer != NULL) return tokenizer->col;
+    return tokens->cols[token_index];
+}
 
-            if (next_token != ',') return ERROR("expecting ',' in arguments");
-            get_next_token();  // Consume ','
-        }
+ExprAST *Parser::parse_number_expr() {
+    const NumberLiteral &literal = number();
+    ExprAST *result;
+    if (literal.is_integer) {
+        result = arena->make<NumberAST>(literal.integer);
+    } else {
+        result = arena->make<NumberAST>(literal.real);
     }
-    get_next_token();  // Consume ')'
-
-    return new CallAST(identifier_name, args);
+    get_next_token();  // Consume the number
+    return result;
 }
 
-ExprAST *Parser::parse_primary_expr() {
+ExprAST *Parser::expected_expression() {
     switch (next_token) {
+    case tokInvalid:
+        return ERROR("%s", token_error().c_str());
     default:
         return ERROR("unknown token '%s' while expecting expression",
                      token_name(next_token));
-    case tokIdentifier:
-        return Parser::parse_identifer_expr();
-    case tokNumber:
-        return Parser::parse_number_expr();
-    case '(':
-        return Parser::parse_paren_expr();
     }
 }
 
-int Parser::get_token_precedence() {
-    int precedence = operator_precedence[next_token];
-    if (precedence <= 0) return -1;
-    return precedence;
+// Replaces the top two operands with the top operator applied to them
+void Parser::reduce_operator() {
+    int op = operator_stack.back().token;
+    operator_stack.pop_back();
+    ExprAST *rhs = expr_stack.back();
+    expr_stack.pop_back();
+    ExprAST *lhs = expr_stack.back();
+    expr_stack.back() = arena->make<BinaryExprAST>(lhs, op, rhs);
 }
 
+// Parses an expression with an explicit operand and operator stack instead
+// of recursing, so long chains of operators and deeply nested parentheses
+// and calls take linear time and no native stack. Parentheses and calls sit
+// on the operator stack as markers that operators can't be reduced past.
 ExprAST *Parser::parse_expression() {
-    ExprAST *lhs = parse_primary_expr();
-    if (lhs == NULL) return 0;
+    size_t operand_mark = expr_stack.size();
+    size_t operator_mark = operator_stack.size();
+    bool expect_operand = true;
+    while (true) {
+        if (expect_operand) {
+            if (next_token == tokNumber) {
+                expr_stack.push_back(parse_number_expr());
+                expect_operand = false;
+            } else if (next_token == tokIdentifier) {
+                Symbol name = identifier();
+                get_next_token();  // Consume identifier string
+                if (next_token != '(') {
+                    expr_stack.push_back(arena->make<VariableAST>(name));
+                    expect_operand = false;
+                    continue;
+                }
+                get_next_token();  // Consume '('
+                if (next_token == ')') {
+                    get_next_token();  // Consume ')'
+                    expr_stack.push_back(
+                        arena->make<CallAST>(name, ArenaArray<ExprAST*>()));
+                    expect_operand = false;
+                    continue;
+                }
+                PendingOperator call = {tokIdentifier, 0, name,
+                                        expr_stack.size()};
+                operator_stack.push_back(call);
+            } else if (next_token == '(') {
+                get_next_token();  // Consume '('
+                PendingOperator paren = {'(', 0, 0, 0};
+                operator_stack.push_back(paren);
+            } else {
+                return expected_expression();
+            }
+            continue;
+        }
 
-    return parse_binop_rhs(0, lhs);
-}
+        // We have an operand, so this is either a binary operator...
+        OperatorInfo info = operator_of(next_token);
+        if (info.precedence > 0) {
+            // Finish the operators on the stack that bind at least as
+            // strongly as this one
+            while (operator_stack.size() > operator_mark) {
+                const PendingOperator &top = operator_stack.back();
+                if (top.precedence == 0) break;  // A parenthesis or call
+                if (top.precedence < info.precedence) break;
+                if (top.precedence == info.precedence &&
+                    info.right_associative) break;
+                reduce_operator();
+            }
+            PendingOperator op = {next_token, info.precedence, 0, 0};
+            operator_stack.push_back(op);
+            get_next_token();  // Consume operator
+            expect_operand = true;
+            continue;
+        }
+
+        // ...or the end of something. Finish every operator back to the
+        // innermost parenthesis or call, or to the start of the expression.
+        while (operator_stack.size() > operator_mark &&
+               operator_stack.back().precedence > 0) {
+            reduce_operator();
+        }
+        if (operator_stack.size() == operator_mark) break;
+
+        PendingOperator &open = operator_stack.back();
+        if (open.token == '(') {
+            if (next_token != ')') return ERROR("expected ')'");
+            get_next_token();  // Consume ')'
+            operator_stack.pop_back();
+        } else if (next_token == ',') {
+            get_next_token();  // Consume ','
+            expect_operand = true;
+        } else if (next_token == ')') {
+            get_next_token();  // Consume ')'
+            Symbol callee = open.callee;
+            ArenaArray<ExprAST*> args =
+                arena->pop_array(&expr_stack, open.args_mark);
+            operator_stack.pop_back();
+            expr_stack.push_back(arena->make<CallAST>(callee, args));
+        } else {
+            return ERROR("expecting ',' in arguments");
+        }
+    }
 
+    ExprAST *result = expr_stack.back();
+    expr_stack.resize(operand_mark);
+    return result;
+}
 StatementAST *Parser::parse_assignment() {
     if (next_token != tokLet) {
         return ERROR("ICE: Expecting 'let' in Parser::parse_assignment");
     }
     get_next_token();  // Consume the 'let'
 
-    std::string name;
+    Symbol name;
     if (next_token != tokIdentifier) {
         return ERROR("expecting variable name after 'let'");
     }
-    name = tokenizer.identifier_string;
+    name = identifier();
     get_next_token();  // Consume the LHS
 
     if (next_token != '=') return ERROR("expecting = after variable name "
@@ -128,7 +247,7 @@ StatementAST *Parser::parse_assignment() {
     ExprAST *rhs = parse_expression();
     if (rhs == NULL) return ERROR("expecting expression after '='");
 
-    return new AssignmentAST(name, rhs);
+    return arena->make<AssignmentAST>(name, rhs);
 }
 
 StatementAST *Parser::parse_reassignment() {
@@ -137,11 +256,11 @@ StatementAST *Parser::parse_reassignment() {
     }
     get_next_token();  // Consume the 'let'
 
-    std::string name;
+    Symbol name;
     if (next_token != tokIdentifier) {
         return ERROR("expecting variable name after 're'");
     }
-    name = tokenizer.identifier_string;
+    name = identifier();
     get_next_token();  // Consume the LHS
 
     if (next_token != '=') return ERROR("expecting = after variable name "
@@ -151,21 +270,21 @@ StatementAST *Parser::parse_reassignment() {
     ExprAST *rhs = parse_expression();
     if (rhs == NULL) return ERROR("expecting expression after '='");
 
-    return new ReassignAST(name, rhs);
+    return arena->make<ReassignAST>(name, rhs);
 }
 
 StatementAST *Parser::parse_return() {
     if (next_token != tokReturn) {
-        ERROR("ICE: expecting return in Parser::parse_return");
+        return ERROR("ICE: expecting return in Parser::parse_return");
     }
     get_next_token();  // Consume 'return'
 
     // Get the value to be returned
     ExprAST *rvalue = parse_expression();
     if (rvalue == NULL) {
-        ERROR("expecting expression after 'return' keyword");
+        return ERROR("expecting expression after 'return' keyword");
     }
-    return new ReturnAST(rvalue);
+    return arena->make<ReturnAST>(rvalue);
 }
 
 StatementAST *Parser::parse_line() {
@@ -205,12 +324,14 @@ StatementAST *Parser::parse_ifelse() {
     }
     get_next_token();  // Consume the indent token
 
-    std::vector<StatementAST*> ifbody;
+    size_t ifbody_mark = statement_stack.size();
     while (next_token != tokDedent) {
         auto line = parse_line();
         if (line == NULL) return ERROR("Error parsing body of if");
-        ifbody.push_back(line);
+        statement_stack.push_back(line);
     }
+    ArenaArray<StatementAST*> ifbody =
+        arena->pop_array(&statement_stack, ifbody_mark);
 
     get_next_token();  // Consume the unindent token
     if (next_token != tokElse) return ERROR("if without else unsupported");
@@ -224,16 +345,18 @@ StatementAST *Parser::parse_ifelse() {
     }
     get_next_token();  // Consume the indentation token
 
-    std::vector<StatementAST*> elsebody;
+    size_t elsebody_mark = statement_stack.size();
     while (next_token != tokDedent) {
         auto line = parse_line();
         if (line == NULL) return ERROR("Error parsing body of else");
-        elsebody.push_back(line);
+        statement_stack.push_back(line);
     }
+    ArenaArray<StatementAST*> elsebody =
+        arena->pop_array(&statement_stack, elsebody_mark);
 
     get_next_token();  // Consume the unindent token
 
-    return new IfElseAST(condition, ifbody, elsebody);
+    return arena->make<IfElseAST>(condition, ifbody, elsebody);
 }
 
 FunctionAST *Parser::parse_function() {
@@ -245,7 +368,7 @@ FunctionAST *Parser::parse_function() {
     if (next_token != tokIdentifier) {
         return ERROR("expecting identifier after def");
     }
-    std::string function_name = tokenizer.identifier_string;
+    Symbol function_name = identifier();
     get_next_token();  // Consume identifier string
 
     if (next_token != '(') {
@@ -253,14 +376,14 @@ FunctionAST *Parser::parse_function() {
     }
     get_next_token();  // Consume '('
 
-    std::vector<std::string> args;
+    size_t args_mark = symbol_stack.size();
     if (next_token != ')') {
         while (true) {
             if (next_token != tokIdentifier) {
                 return ERROR("expecting identifier in argument list");
             }
             // Save the argument name
-            args.push_back(tokenizer.identifier_string);
+            symbol_stack.push_back(identifier());
             get_next_token();  // Consume the argument name
 
             if (next_token != ':') {
@@ -308,7 +431,7 @@ FunctionAST *Parser::parse_function() {
     }
     get_next_token();  // Consume the indentation token
 
-    std::vector<StatementAST*> body;
+    size_t body_mark = statement_stack.size();
     // As long as the code is indented the same amount, read it
     do {
         // Parse a line of the body
@@ -316,14 +439,21 @@ FunctionAST *Parser::parse_function() {
         // If parsing the line fails, bail!
         if (expr == NULL) return ERROR("error in function body?");
         // Otherwise, add it to the body
-        body.push_back(expr);
+        statement_stack.push_back(expr);
     } while (next_token != tokDedent);
     get_next_token();  // Consume unindent token
-    PrototypeAST *proto = new PrototypeAST(function_name, args);
-    return new FunctionAST(proto, body);
+    ArenaArray<StatementAST*> body =
+        arena->pop_array(&statement_stack, body_mark);
+    ArenaArray<Symbol> args = arena->pop_array(&symbol_stack, args_mark);
+    PrototypeAST *proto = arena->make<PrototypeAST>(function_name, args);
+    return arena->make<FunctionAST>(proto, body);
 }
 
 FunctionAST *Parser::parse_top_level() {
+    // Anything left on the stacks is from a definition that failed to parse
+    expr_stack.clear();
+    statement_stack.clear();
+    symbol_stack.clear();
     // TODO(Caleb Jones) Is it safe to just skip blank lines like this?
     while (next_token == tokNewline) {
         // std::cerr << "Skipping toplevel newline" << std::endl;
@@ -336,40 +466,10 @@ FunctionAST *Parser::parse_top_level() {
     if (next_token == tokDef) {
         return parse_function();
     } else if (StatementAST *expr = parse_line()) {
-        PrototypeAST *proto = new PrototypeAST("main",
-                                               std::vector<std::string>());
-        std::vector<StatementAST*> body = {expr};
-        return new FunctionAST(proto, body);
+        PrototypeAST *proto = arena->make<PrototypeAST>(SYM_MAIN,
+                                                        ArenaArray<Symbol>());
+        ArenaArray<StatementAST*> body = arena->copy(&expr, 1);
+        return arena->make<FunctionAST>(proto, body);
     }
     return NULL;
 }
-
-ExprAST *Parser::parse_binop_rhs(int expr_precedence, ExprAST *lhs) {
-    while (true) {
-        int tok_precedence = get_token_precedence();
-
-        // If the operator is less strong than the current expression,
-        // we're done
-        if (tok_precedence < expr_precedence) {
-            return lhs;
-        }
-
-        // We know that it's a binary operator since it has > 0 precedence
-        int binop = next_token;
-        get_next_token();  // Consume operator
-
-        // Parse the next expression for the RHS
-        ExprAST *rhs = parse_primary_expr();
-        if (rhs == NULL) return NULL;
-
-        // If this binds more strongly, recurse into it
-        int next_precedence = get_token_precedence();
-        if (tok_precedence < next_precedence) {
-            // Recurse into parsing! Elegance!
-            rhs = parse_binop_rhs(tok_precedence+1, rhs);
-            if (rhs == NULL) return NULL;
-        }
-
-        lhs = new BinaryExprAST(lhs, binop, rhs);
-    }  // while loop
-}
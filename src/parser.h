@@ -3,30 +3,66 @@
 #define LENS_PARSER_H_
 
 #include <string>
-#include <map>
+#include <vector>
+
+#include "src/arena.h"
+
+#include "src/symbol.h"
+#include "src/tokenizer.h"
 
 class ExprAST;
 class FunctionAST;
 class StatementAST;
 
-class Tokenizer;
+class TokenBuffer;
+
+// An operator, parenthesis or call that parse_expression has started but
+// not finished
+struct PendingOperator {
+    // The binary operator token, '(' for a parenthesis, or tokIdentifier
+    // for a call
+    int token;
+    int precedence;
+    // For calls: the function, and where its arguments start on the
+    // operand stack
+    Symbol callee;
+    size_t args_mark;
+};
 
 class Parser {
-    Tokenizer &tokenizer;
-    std::map<int, int> operator_precedence;
+    // Tokens come either straight from a Tokenizer, or from a TokenBuffer
+    // that was filled ahead of time, which is walked by index
+    Tokenizer *tokenizer;
+    TokenBuffer *tokens;
+    size_t token_index;
+    // Owns every node the parser makes
+    Arena *arena;
+    // Scratch space for building lists of nodes, reused for every list
+    std::vector<ExprAST*> expr_stack;
+    std::vector<StatementAST*> statement_stack;
+    std::vector<Symbol> symbol_stack;
+    // parse_expression keeps its operands on expr_stack, and the operators
+    // waiting for their right hand side here
+    std::vector<PendingOperator> operator_stack;
+    int read_token();
+    // The payload and position of next_token
+    Symbol identifier() const;
+    const NumberLiteral &number() const;
+    const std::string &token_error() const;
+    int error_line() const;
+    int error_col() const;
+    ExprAST *expected_expression();
+    void reduce_operator();
 
  public:
-    explicit Parser(Tokenizer &tok);
+    Parser(Tokenizer &tok, Arena *arena);
+    Parser(TokenBuffer &tok, Arena *arena);
     int next_token;
     int get_next_token();
     StatementAST *parse_line();
     ExprAST *parse_number_expr();
-    ExprAST *parse_identifer_expr();
-    ExprAST *parse_paren_expr();
-    ExprAST *parse_primary_expr();
     StatementAST *parse_assignment();
     StatementAST *parse_reassignment();
-    ExprAST *parse_binop_rhs(int precedence, ExprAST *lhs);
     StatementAST *parse_return();
     StatementAST *parse_ifelse();
 
@@ -34,7 +70,6 @@ class Parser {
     FunctionAST *parse_top_level();
 
     ExprAST *parse_expression();
-    int get_token_precedence();
 
     void Error(std::string msg);
 };
@@ -1,54 +1,219 @@
 // Copyright (c) 2015 Caleb Jones
 #include "src/reader.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <iostream>
 
-Line::Line(int linenum, int indent, std::string text, bool is_eof)
-    : is_eof(is_eof), line_number(linenum), indentation(indent), text(text) {}
+#include "src/scan.h"
+
+// Indentation width of the blank characters at the start of a line
+static int measure_indent(const char *text, size_t length) {
+    int indent = 0;
+    for (size_t i = 0; i < length; i++) {
+        // Tabs are worth 8 spaces
+        indent += (text[i] == '\t') ? 8 : 1;
+    }
+    return indent;
+}
+
+Line::Line(int linenum, int indent, const char *text, size_t length,
+           size_t offset, bool is_eof)
+    : is_eof(is_eof), line_number(linenum), indentation(indent), text(text),
+      length(length), offset(offset) {}
 
 std::ostream &operator<<(std::ostream& out, const Line &l) {
-    out << l.line_number << ":" << l.indentation << " " << l.text;
+    out << l.line_number << ":" << l.indentation << " ";
+    out.write(l.text, l.length);
     return out;
 }
 
-Reader::Reader(std::string filename) {
-    input_stream = std::ifstream(filename);
+Reader::Reader(std::string filename, int mode)
+    : mode(mode), buffer(NULL), buffer_size(0), fd(-1), read_index(0),
+      read_end(0), position(0), base_offset(0), base_line(0), line_no(0),
+      done(false) {
     lines = std::vector<Line>();
-    line_no = 0;
+    if (mode == READ_RING) {
+        fd = open(filename.c_str(), O_RDONLY);
+        read_buffer.resize(kReadBufferSize);
+        lines.reserve(kRingSize);
+        return;
+    }
+    // Fall back to reading the stream if the file can't be mapped
+    // (pipes, for example)
+    if (mode == READ_MMAP && !map_file(filename)) {
+        this->mode = READ_STREAM;
+    }
+    if (this->mode == READ_STREAM) {
+        input_stream.open(filename);
+    }
 }
 
+Reader::Reader(const char *text, size_t size, size_t offset, int first_line)
+    : mode(READ_MEMORY), buffer(text), buffer_size(size), fd(-1),
+      read_index(0), read_end(0), position(0), base_offset(offset),
+      base_line(first_line - 1), line_no(0), done(false) {}
+
 Reader::~Reader() {
-    input_stream.close();
+    if (mode == READ_RING) {
+        if (fd >= 0) close(fd);
+    } else if (mode == READ_MMAP) {
+        if (buffer_size > 0) {
+            munmap(const_cast<char*>(buffer), buffer_size);
+        }
+    } else if (mode == READ_STREAM) {
+        input_stream.close();
+    }
+}
+
+const char *Reader::text() const {
+    if (mode == READ_MMAP || mode == READ_MEMORY) return buffer;
+    return NULL;
+}
+
+size_t Reader::size() const {
+    if (mode == READ_MMAP || mode == READ_MEMORY) return buffer_size;
+    return 0;
+}
+
+bool Reader::map_file(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return false;
+    }
+    buffer_size = info.st_size;
+    // mmap refuses to map zero bytes, but an empty file is still valid
+    if (buffer_size > 0) {
+        void *mapping = mmap(NULL, buffer_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            buffer_size = 0;
+            return false;
+        }
+        // We only ever walk forward through the file
+        madvise(mapping, buffer_size, MADV_SEQUENTIAL);
+        buffer = static_cast<const char*>(mapping);
+    }
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return true;
 }
 
 Line Reader::read_line() {
-    if (input_stream.eof()) {
+    if (mode == READ_MMAP || mode == READ_MEMORY) return read_mapped_line();
+    return read_stream_line();
+}
+
+Line Reader::read_stream_line() {
+    std::string text;
+    if (!std::getline(input_stream, text)) {
         done = true;
-        return Line(line_no + 1, 0, "\n", true);
+        return Line(line_no + 1, 0, "", 0, position, true);
     }
-    int indent = 0;
-    char next_char;
-    while (isblank(next_char = input_stream.get())) {
-        if (next_char == '\t') {
-            // Tabs are worth 8 spaces
-            indent += 8;
-        } else {
-            indent++;
+    // Keep the text alive for as long as the Line that points at it
+    line_storage.push_back(std::move(text));
+    const std::string &stored = line_storage.back();
+    size_t start = scan_blanks(stored.data(), stored.size());
+    int indent = measure_indent(stored.data(), start);
+    size_t offset = position + start;
+    // Skip over the text and the '\n' that getline consumed
+    position += stored.size() + 1;
+    // Use line_no + 1 because this is a new line
+    return Line(line_no + 1, indent, stored.data() + start,
+                stored.size() - start, offset, false);
+}
+
+Line Reader::read_mapped_line() {
+    if (position >= buffer_size) {
+        done = true;
+        return Line(base_line + line_no + 1, 0, "", 0,
+                    base_offset + buffer_size, true);
+    }
+    const char *cursor = buffer + position;
+    const char *end = buffer + buffer_size;
+    size_t blanks = scan_blanks(cursor, end - cursor);
+    int indent = measure_indent(cursor, blanks);
+    cursor += blanks;
+    const char *newline = static_cast<const char*>(
+        memchr(cursor, '\n', end - cursor));
+    // The last line doesn't need to end with a newline
+    if (newline == NULL) newline = end;
+    // Skip over the '\n' as well
+    position = (newline - buffer) + 1;
+    // Use line_no + 1 because this is a new line
+    return Line(base_line + line_no + 1, indent, cursor, newline - cursor,
+                base_offset + (cursor - buffer), false);
+}
+
+bool Reader::refill() {
+    if (fd < 0) return false;
+    ssize_t count;
+    do {
+        count = read(fd, read_buffer.data(), read_buffer.size());
+    } while (count < 0 && errno == EINTR);
+    if (count <= 0) return false;
+    read_index = 0;
+    read_end = count;
+    return true;
+}
+
+Line Reader::read_ring_line(std::string *storage) {
+    // Reuse the slot's string so its capacity carries over between lines
+    storage->clear();
+    bool found_any = false;
+    while (true) {
+        if (read_index == read_end && !refill()) break;
+        found_any = true;
+        const char *start = read_buffer.data() + read_index;
+        size_t available = read_end - read_index;
+        const char *newline = static_cast<const char*>(
+            memchr(start, '\n', available));
+        if (newline != NULL) {
+            storage->append(start, newline - start);
+            // Skip over the '\n' as well
+            read_index += (newline - start) + 1;
+            break;
         }
+        // The line continues into the next chunk of the file
+        storage->append(start, available);
+        read_index = read_end;
     }
-    std::string line = "";
-    while (next_char != '\n' && !input_stream.eof()) {
-        line += next_char;
-        next_char = input_stream.get();
+    if (!found_any) {
+        done = true;
+        return Line(line_no + 1, 0, "", 0, position, true);
     }
-    line += '\n';
+    size_t start = scan_blanks(storage->data(), storage->size());
+    int indent = measure_indent(storage->data(), start);
+    size_t offset = position + start;
+    position += storage->size() + 1;
     // Use line_no + 1 because this is a new line
-    return Line(line_no + 1, indent, line, false);
+    return Line(line_no + 1, indent, storage->data() + start,
+                storage->size() - start, offset, false);
 }
 
 const Line &Reader::next_line() {
+    if (mode == READ_RING) {
+        // Overwrite the oldest line in the ring
+        size_t slot = line_no % kRingSize;
+        Line l = read_ring_line(&ring_text[slot]);
+        if (slot < lines.size()) {
+            lines[slot] = l;
+        } else {
+            lines.push_back(l);
+        }
+        line_no++;
+        return lines[slot];
+    }
     if (line_no >= lines.size()) {
         lines.push_back(read_line());
     }
@@ -2,6 +2,8 @@
 #ifndef LENS_READER_H_
 #define LENS_READER_H_
 
+#include <cstddef>
+#include <deque>
 #include <fstream>
 #include <string>
 #include <vector>
@@ -10,22 +12,74 @@ struct Line {
     bool is_eof;
     int line_number;
     int indentation;
-    std::string text;
-    Line(int linenum, int indent, std::string text, bool iseof);
+    // A view of the text of the line, starting after the indentation and
+    // stopping before the '\n'. The bytes are owned by the Reader.
+    const char *text;
+    size_t length;
+    // Byte offset of `text` from the start of the source
+    size_t offset;
+    Line(int linenum, int indent, const char *text, size_t length,
+         size_t offset, bool iseof);
     friend std::ostream &operator<<(std::ostream& out, const Line &l);
 };
 
+enum READ_MODES {
+    // Read the file through an ifstream, copying each line into the Reader
+    READ_STREAM,
+    // Map the whole file into memory, lines are views into the mapping
+    READ_MMAP,
+    // Stream the file through a fixed size buffer, only keeping the last
+    // few lines around. Memory use doesn't grow with the size of the file.
+    READ_RING,
+    // Read part of a file that someone else already has in memory
+    READ_MEMORY
+};
+
 class Reader {
+    // How many lines READ_RING keeps alive. The Tokenizer only looks at the
+    // current line, the rest are slack for error reporting.
+    static const int kRingSize = 4;
+    static const size_t kReadBufferSize = 64 * 1024;
+
+    int mode;
     std::ifstream input_stream;
+    // READ_STREAM: the text of every line read so far
+    std::deque<std::string> line_storage;
+    // READ_MMAP and READ_MEMORY: the text, and how far into it we've read
+    const char *buffer;
+    size_t buffer_size;
+    // READ_RING: the file, the fixed size buffer we refill from it, and
+    // the storage for each of the lines in the ring
+    int fd;
+    std::vector<char> read_buffer;
+    size_t read_index;
+    size_t read_end;
+    std::string ring_text[kRingSize];
+    // Byte offset of the start of the next line
+    size_t position;
+    // Where the text starts in the whole file, for READ_MEMORY
+    size_t base_offset;
+    int base_line;
     int line_no;
     bool done;
     std::vector<Line> lines;
+    bool map_file(const std::string &filename);
     Line read_line();
+    Line read_stream_line();
+    Line read_mapped_line();
+    Line read_ring_line(std::string *storage);
+    bool refill();
 
  public:
-    explicit Reader(std::string filename);
+    explicit Reader(std::string filename, int mode = READ_STREAM);
+    // Reads [text, text + size) with READ_MEMORY. `offset` and `first_line`
+    // say where the text starts in the file it came from.
+    Reader(const char *text, size_t size, size_t offset, int first_line);
     ~Reader();
     const Line &next_line();
+    // The whole file, if it's in memory (READ_MMAP or READ_MEMORY)
+    const char *text() const;
+    size_t size() const;
 };
 
 #endif  // LENS_READER_H_
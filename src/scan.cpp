@@ -0,0 +1,118 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/scan.h"
+
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LENS_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// ========================================================================= //
+// Portable fallback
+// ========================================================================= //
+static inline bool is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline bool is_ident(char c) {
+    // Setting 0x20 folds upper case onto lower case, and doesn't move
+    // anything else into a-z
+    char lower = c | 0x20;
+    return (lower >= 'a' && lower <= 'z') || is_digit(c) || c == '_';
+}
+
+static size_t scan_blanks_scalar(const char *text, size_t length) {
+    size_t i = 0;
+    while (i < length && is_blank(text[i])) i++;
+    return i;
+}
+
+static size_t scan_ident_scalar(const char *text, size_t length) {
+    size_t i = 0;
+    while (i < length && is_ident(text[i])) i++;
+    return i;
+}
+
+static size_t scan_digits_scalar(const char *text, size_t length) {
+    size_t i = 0;
+    while (i < length && is_digit(text[i])) i++;
+    return i;
+}
+
+#ifdef LENS_SCAN_X86
+// ========================================================================= //
+// SSE2, 16 bytes at a time
+// ========================================================================= //
+// There are only signed byte compares, so shift [lo, hi] down to start at
+// -128 and check that the shifted value is below the end of the range.
+#define SSE2 __attribute__((target("sse2")))
+
+SSE2 static inline __m128i in_range_sse2(__m128i v, char lo, char hi) {
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8(-128 - lo));
+    return _mm_cmplt_epi8(shifted, _mm_set1_epi8(-128 + (hi - lo) + 1));
+}
+
+SSE2 static inline __m128i blanks_sse2(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+}
+
+SSE2 static inline __m128i digits_sse2(__m128i v) {
+    return in_range_sse2(v, '0', '9');
+}
+
+SSE2 static inline __m128i ident_sse2(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = in_range_sse2(lower, 'a', 'z');
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digits_sse2(v)), underscore);
+}
+
+// Runs `match` over each full 16 byte block, stopping at the first byte that
+// isn't in the run, and finishes the tail with `scalar`
+#define SCAN_SSE2(match, scalar)                                            \
+    size_t i = 0;                                                           \
+    while (i + 16 <= length) {                                              \
+        __m128i block = _mm_loadu_si128(                                    \
+            reinterpret_cast<const __m128i*>(text + i));                    \
+        unsigned mask = _mm_movemask_epi8(match(block)) ^ 0xFFFF;           \
+        if (mask != 0) return i + __builtin_ctz(mask);                      \
+        i += 16;                                                            \
+    }                                                                       \
+    return i + scalar(text + i, length - i);
+
+SSE2 static size_t scan_blanks_sse2(const char *text, size_t length) {
+    SCAN_SSE2(blanks_sse2, scan_blanks_scalar)
+}
+
+SSE2 static size_t scan_ident_sse2(const char *text, size_t length) {
+    SCAN_SSE2(ident_sse2, scan_ident_scalar)
+}
+
+SSE2 static size_t scan_digits_sse2(const char *text, size_t length) {
+    SCAN_SSE2(digits_sse2, scan_digits_scalar)
+}
+#endif  // LENS_SCAN_X86
+
+static ScanKernels select_scan_kernels() {
+#ifdef LENS_SCAN_X86
+    // This runs during static initialization, before the CPU model is
+    // guaranteed to be set up
+    __builtin_cpu_init();
+    // 32 byte AVX2 kernels tokenized slower than these, since most runs
+    // are shorter than one 16 byte block
+    if (__builtin_cpu_supports("sse2")) {
+        return ScanKernels{"sse2", scan_blanks_sse2, scan_ident_sse2,
+                           scan_digits_sse2};
+    }
+#endif
+    return ScanKernels{"scalar", scan_blanks_scalar, scan_ident_scalar,
+                       scan_digits_scalar};
+}
+
+const ScanKernels scan_kernels = select_scan_kernels();
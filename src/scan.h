@@ -0,0 +1,35 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_SCAN_H_
+#define LENS_SCAN_H_
+
+#include <cstddef>
+
+// Kernels for finding the end of a run of similar characters. Each one
+// returns how many characters at the start of [text, text + length) are in
+// the run. SSE2 is used where the CPU has it, and plain C++ elsewhere,
+// picked once at startup.
+struct ScanKernels {
+    const char *name;
+    // [ \t]*
+    size_t (*blanks)(const char *text, size_t length);
+    // [a-zA-Z0-9_]*
+    size_t (*ident)(const char *text, size_t length);
+    // [0-9]*
+    size_t (*digits)(const char *text, size_t length);
+};
+
+extern const ScanKernels scan_kernels;
+
+inline size_t scan_blanks(const char *text, size_t length) {
+    return scan_kernels.blanks(text, length);
+}
+
+inline size_t scan_ident(const char *text, size_t length) {
+    return scan_kernels.ident(text, length);
+}
+
+inline size_t scan_digits(const char *text, size_t length) {
+    return scan_kernels.digits(text, length);
+}
+
+#endif  // LENS_SCAN_H_
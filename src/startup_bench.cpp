@@ -0,0 +1,109 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/startup_bench.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include "src/ast.h"
+#include "src/codegen.h"
+#include "src/interpreter.h"
+#include "src/jit.h"
+#include "src/lazy_jit.h"
+#include "src/optimize.h"
+#include "src/options.h"
+#include "src/timer.h"
+
+using namespace llvm;
+
+// Points stdout at /dev/null, returning a descriptor for the real one
+static int silence_stdout() {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+    return saved;
+}
+
+static void restore_stdout(int saved) {
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+// Generates, optimizes and runs the whole program the way --run does, in a
+// module of its own so it can be done again
+static void run_whole_module(const std::vector<FunctionAST*> &functions,
+                             const std::map<Symbol, size_t> &signatures,
+                             const Options &options) {
+    Module *module = new Module("bench", TheContext());
+    CodegenContext codegen(&TheContext(), module);
+    codegen.signatures = &signatures;
+    CodegenContext *previous = set_codegen_context(&codegen);
+    generate_prelude(module);
+    for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+        (*iter)->codegen();
+    }
+    set_codegen_context(previous);
+    optimize_module(module, options.opt_level, options.size_level);
+    int exit_code;
+    run_module(module, options, &exit_code);
+}
+
+void bench_startup(const std::vector<FunctionAST*> &functions,
+                   const Options &options) {
+    std::vector<Symbol> names;
+    std::map<Symbol, size_t> signatures;
+    for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+        names.push_back((*iter)->name());
+        signatures[(*iter)->name()] = (*iter)->arg_count();
+    }
+    if (signatures.count(SYM_MAIN) == 0) {
+        fprintf(stderr, "There's no top level code to run\n");
+        return;
+    }
+    std::function<bool(size_t)> generate = [&](size_t i) {
+        return functions[i]->codegen() != NULL;
+    };
+    // Measure the work, not our reporting or what's left in the cache
+    Options quiet = options;
+    quiet.time_phases = false;
+    quiet.use_cache = false;
+    Options interpret_only = quiet;
+    interpret_only.tier_up = 0;
+
+    double interpreted = 1e300, tiered = 1e300, lazy = 1e300, whole = 1e300;
+    int exit_code;
+    int saved = silence_stdout();
+    for (int round = 0; round < kBenchRounds; round++) {
+        Timer timer;
+        interpret_program(functions, interpret_only, &exit_code);
+        interpreted = std::min(interpreted, timer.milliseconds());
+
+        timer.restart();
+        interpret_program(functions, quiet, &exit_code);
+        tiered = std::min(tiered, timer.milliseconds());
+
+        timer.restart();
+        run_lazy(names, signatures, generate, quiet, &exit_code);
+        lazy = std::min(lazy, timer.milliseconds());
+
+        timer.restart();
+        run_whole_module(functions, signatures, quiet);
+        whole = std::min(whole, timer.milliseconds());
+    }
+    restore_stdout(saved);
+
+    printf("%zu functions, -O%c, best of %d runs\n", functions.size(),
+           opt_level_name(options), kBenchRounds);
+    printf("interpret        %10.3f ms\n", interpreted);
+    printf("tiered (%5u)   %10.3f ms\n", options.tier_up, tiered);
+    printf("lazy jit         %10.3f ms\n", lazy);
+    printf("jit              %10.3f ms\n", whole);
+}
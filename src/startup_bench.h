@@ -0,0 +1,17 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_STARTUP_BENCH_H_
+#define LENS_STARTUP_BENCH_H_
+
+#include <vector>
+
+class FunctionAST;
+struct Options;
+
+// Runs the program a few times in each of the ways it can be run: in the
+// interpreter alone, tiered up to the JIT, with the lazy JIT and with the
+// whole module JIT compiled up front. Prints how long each one took from
+// the parsed AST to main returning. The program's own output is thrown away.
+void bench_startup(const std::vector<FunctionAST*> &functions,
+                   const Options &options);
+
+#endif  // LENS_STARTUP_BENCH_H_
@@ -0,0 +1,80 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/symbol.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Hashes eight bytes at a time, identifiers are usually short enough that
+// this is only a couple of rounds
+static uint32_t hash_text(const char *text, size_t length) {
+    const uint64_t kMultiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = length * kMultiplier;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, text, 8);
+        hash = (hash ^ word) * kMultiplier;
+        hash ^= hash >> 32;
+        text += 8;
+        length -= 8;
+    }
+    if (length > 0) {
+        uint64_t word = 0;
+        memcpy(&word, text, length);
+        hash = (hash ^ word) * kMultiplier;
+        hash ^= hash >> 32;
+    }
+    return static_cast<uint32_t>(hash);
+}
+
+const Symbol SymbolTable::kEmptySlot;
+
+SymbolTable::SymbolTable() : slots(64, Slot{0, kEmptySlot}) {
+    // These have to be interned in the same order as WELL_KNOWN_SYMBOLS
+    intern("main");
+    intern("printi64");
+    intern("printf");
+}
+
+void SymbolTable::grow() {
+    std::vector<Slot> old_slots(slots.size() * 2, Slot{0, kEmptySlot});
+    old_slots.swap(slots);
+    size_t mask = slots.size() - 1;
+    for (const Slot &old : old_slots) {
+        if (old.symbol == kEmptySlot) continue;
+        size_t slot = old.hash & mask;
+        while (slots[slot].symbol != kEmptySlot) slot = (slot + 1) & mask;
+        slots[slot] = old;
+    }
+}
+
+Symbol SymbolTable::intern(const char *text, size_t length) {
+    uint32_t hash = hash_text(text, length);
+    std::lock_guard<std::mutex> guard(lock);
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot].symbol != kEmptySlot) {
+        if (slots[slot].hash == hash) {
+            Symbol symbol = slots[slot].symbol;
+            const std::string &existing = names[symbol];
+            if (existing.size() == length &&
+                memcmp(existing.data(), text, length) == 0) {
+                return symbol;
+            }
+        }
+        slot = (slot + 1) & mask;
+    }
+    // This is the first time we've seen the name, so this is the only time
+    // its text gets copied
+    Symbol symbol = names.size();
+    names.push_back(std::string(text, length));
+    slots[slot] = Slot{hash, symbol};
+    // Keep the load factor under a half
+    if (names.size() * 2 > slots.size()) grow();
+    return symbol;
+}
+
+SymbolTable &Symbols() {
+    static SymbolTable table;
+    return table;
+}
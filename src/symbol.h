@@ -0,0 +1,62 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_SYMBOL_H_
+#define LENS_SYMBOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// An interned identifier. Two identifiers are the same name exactly when
+// their Symbols are equal.
+typedef uint32_t Symbol;
+
+// Names the compiler itself needs to refer to, interned up front so they
+// have fixed Symbols
+enum WELL_KNOWN_SYMBOLS {
+    SYM_MAIN,
+    SYM_PRINTI64,
+    SYM_PRINTF,
+    NUM_WELL_KNOWN_SYMBOLS
+};
+
+class SymbolTable {
+    static const Symbol kEmptySlot = UINT32_MAX;
+    // The text of each Symbol, indexed by Symbol. A deque so that references
+    // handed out by name() stay valid as the table grows.
+    std::deque<std::string> names;
+    // Open addressing hash table of Symbols, its size is a power of two.
+    // The hash is kept next to the Symbol so most probes that miss don't
+    // have to look at the text.
+    struct Slot {
+        uint32_t hash;
+        Symbol symbol;
+    };
+    std::vector<Slot> slots;
+    // Files can be lexed on several threads at once
+    mutable std::mutex lock;
+    void grow();
+
+ public:
+    SymbolTable();
+    Symbol intern(const char *text, size_t length);
+    Symbol intern(const std::string &text) {
+        return intern(text.data(), text.size());
+    }
+    // Strings in the table never move, so the reference stays valid
+    const std::string &name(Symbol symbol) const {
+        std::lock_guard<std::mutex> guard(lock);
+        return names[symbol];
+    }
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return names.size();
+    }
+};
+
+// The symbol table for the current compilation
+SymbolTable &Symbols();
+
+#endif  // LENS_SYMBOL_H_
@@ -0,0 +1,16 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_TABLE_H_
+#define LENS_TABLE_H_
+
+// Expand f(c), f(c + 1), ... to fill in a constexpr lookup table, since a
+// C++11 constexpr function can't build the array with a loop
+#define TABLE4(f, c) f(c), f(c + 1), f(c + 2), f(c + 3)
+#define TABLE16(f, c) TABLE4(f, c), TABLE4(f, c + 4), TABLE4(f, c + 8), \
+    TABLE4(f, c + 12)
+#define TABLE64(f, c) TABLE16(f, c), TABLE16(f, c + 16), TABLE16(f, c + 32), \
+    TABLE16(f, c + 48)
+// f(0) to f(255), one for each byte value
+#define TABLE256(f) TABLE64(f, 0), TABLE64(f, 64), TABLE64(f, 128), \
+    TABLE64(f, 192)
+
+#endif  // LENS_TABLE_H_
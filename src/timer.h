@@ -0,0 +1,26 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_TIMER_H_
+#define LENS_TIMER_H_
+
+#include <chrono>
+
+// How many times --bench-ast and --bench-startup repeat each measurement.
+// The fastest run is reported.
+static const int kBenchRounds = 5;
+
+// Measures wall clock time from when it's made, or last restarted
+class Timer {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start;
+
+ public:
+    Timer() : start(Clock::now()) {}
+    void restart() { start = Clock::now(); }
+    double milliseconds() const {
+        std::chrono::duration<double, std::milli> elapsed =
+            Clock::now() - start;
+        return elapsed.count();
+    }
+};
+
+#endif  // LENS_TIMER_H_
@@ -0,0 +1,29 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/token_buffer.h"
+
+#include <string>
+#include <vector>
+
+#include "src/tokenizer.h"
+
+void TokenBuffer::lex(Tokenizer *tokenizer) {
+    while (true) {
+        int token = tokenizer->get_token();
+        uint32_t payload = 0;
+        if (token == tokIdentifier) {
+            payload = tokenizer->identifier_symbol;
+        } else if (token == tokNumber) {
+            payload = numbers.size();
+            numbers.push_back(tokenizer->number);
+        } else if (token == tokInvalid) {
+            payload = errors.size();
+            errors.push_back(tokenizer->token_error);
+        }
+        kinds.push_back(token);
+        offsets.push_back(tokenizer->token_offset);
+        lines.push_back(tokenizer->token_line);
+        cols.push_back(tokenizer->token_col);
+        payloads.push_back(payload);
+        if (token == tokEOF) break;
+    }
+}
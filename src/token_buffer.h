@@ -0,0 +1,34 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_TOKEN_BUFFER_H_
+#define LENS_TOKEN_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "src/tokenizer.h"
+
+// Every token in a file, lexed up front and stored as parallel arrays.
+// Token i is described by kinds[i], offsets[i], lines[i], cols[i] and
+// payloads[i]. The payload is the Symbol for identifiers, an index into
+// `numbers` for numbers, an index into `errors` for invalid tokens, and
+// unused for everything else.
+class TokenBuffer {
+ public:
+    std::vector<int16_t> kinds;
+    // Byte offset of the start of the token in the source
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> lines;
+    std::vector<uint32_t> cols;
+    std::vector<uint32_t> payloads;
+    std::vector<NumberLiteral> numbers;
+    // The Tokenizer's token_error for each tokInvalid
+    std::vector<std::string> errors;
+
+    // Lex everything up to and including the tokEOF
+    void lex(Tokenizer *tokenizer);
+    size_t size() const { return kinds.size(); }
+};
+
+#endif  // LENS_TOKEN_BUFFER_H_
@@ -3,15 +3,153 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <iostream>
 
 #include "src/reader.h"
+#include "src/scan.h"
+#include "src/table.h"
 
-Tokenizer::Tokenizer(Reader &r) : reader(r), line(&reader.next_line()), col(0) {
+// ========================================================================= //
+// Character classes
+// ========================================================================= //
+enum CHAR_CLASSES {
+    CHAR_BLANK = 1 << 0,        // ' ' and '\t'
+    CHAR_IDENT_START = 1 << 1,  // [a-zA-Z_]
+    CHAR_DIGIT = 1 << 2,        // [0-9]
+    CHAR_OPERATOR = 1 << 3      // The first character of a two char operator
+};
+
+// A two character operator, indexed by its first character
+struct OperatorRule {
+    char second;
+    int token;
+};
+
+constexpr OperatorRule operator_rule(int c) {
+    return c == '-' ? OperatorRule{'>', tokProduces}
+         : c == '=' ? OperatorRule{'=', tokEq}
+         : c == '!' ? OperatorRule{'=', tokIneq}
+         : OperatorRule{'\0', tokInvalid};
+}
+
+constexpr unsigned char classify(int c) {
+    return (c == ' ' || c == '\t') ? CHAR_BLANK
+         : ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+           ? CHAR_IDENT_START
+         : (c >= '0' && c <= '9') ? CHAR_DIGIT
+         : operator_rule(c).token != tokInvalid ? CHAR_OPERATOR
+         : 0;
+}
+
+static constexpr unsigned char char_class[256] = { TABLE256(classify) };
+static constexpr OperatorRule operator_rules[256] = {
+    TABLE256(operator_rule) };
+
+static inline unsigned char class_of(char c) {
+    return char_class[static_cast<unsigned char>(c)];
+}
+
+// ========================================================================= //
+// Keywords
+// ========================================================================= //
+struct Keyword {
+    const char *text;
+    size_t length;
+    int token;
+};
+
+static constexpr Keyword keywords[] = {
+    {"def", 3, tokDef},
+    {"let", 3, tokLet},
+    {"re", 2, tokRe},
+    {"mut", 3, tokMut},
+    {"if", 2, tokIf},
+    {"elif", 4, tokElif},
+    {"else", 4, tokElse},
+    {"for", 3, tokFor},
+    {"in", 2, tokIn},
+    {"struct", 6, tokStruct},
+    {"return", 6, tokReturn},
+    {"default", 7, tokDefault},
+    {"pass", 4, tokPass},
+    {"none", 4, tokNone},
+    {"true", 4, tokTrue},
+    {"false", 5, tokFalse},
+    {"i64", 3, tokType},
+};
+static constexpr int kNumKeywords = sizeof(keywords) / sizeof(keywords[0]);
+static constexpr unsigned kKeywordSlots = 32;
+static constexpr size_t kMinKeywordLength = 2;
+static constexpr size_t kMaxKeywordLength = 7;
+
+// Perfect hash over the keyword set, built from the length and the first and
+// last characters. If a new keyword makes the static_assert below fire, pick
+// new multipliers.
+constexpr unsigned keyword_hash(const char *text, size_t length) {
+    return (length * 2 + static_cast<unsigned char>(text[0]) * 10 +
+            static_cast<unsigned char>(text[length - 1]) * 3) %
+           kKeywordSlots;
+}
+
+constexpr unsigned keyword_hash(int index) {
+    return keyword_hash(keywords[index].text, keywords[index].length);
+}
+
+// The index of the keyword that hashes to `slot`, or -1 if none do
+constexpr int keyword_in_slot(unsigned slot, int index = 0) {
+    return index == kNumKeywords ? -1
+         : keyword_hash(index) == slot ? index
+         : keyword_in_slot(slot, index + 1);
+}
+
+// Counts the keywords after `index` that land in the same slot as it
+constexpr int keyword_collisions(int index, int other) {
+    return other == kNumKeywords ? 0
+         : (keyword_hash(index) == keyword_hash(other)) +
+           keyword_collisions(index, other + 1);
+}
+
+constexpr int keyword_collisions(int index = 0) {
+    return index == kNumKeywords ? 0
+         : keyword_collisions(index, index + 1) +
+           keyword_collisions(index + 1);
+}
+
+static_assert(keyword_collisions() == 0,
+              "keyword_hash is no longer perfect over the keyword set");
+
+#define KEYWORD_SLOT(slot) keyword_in_slot(slot)
+static constexpr signed char keyword_slots[kKeywordSlots] = {
+    TABLE16(KEYWORD_SLOT, 0), TABLE16(KEYWORD_SLOT, 16) };
+
+// Returns the keyword token for the text, or tokIdentifier if it isn't one
+static int keyword_token(const char *text, size_t length) {
+    if (length < kMinKeywordLength || length > kMaxKeywordLength) {
+        return tokIdentifier;
+    }
+    int index = keyword_slots[keyword_hash(text, length)];
+    if (index < 0) return tokIdentifier;
+    const Keyword &keyword = keywords[index];
+    if (keyword.length != length ||
+        memcmp(keyword.text, text, length) != 0) {
+        return tokIdentifier;
+    }
+    return keyword.token;
+}
+
+// ========================================================================= //
+// Tokenizer
+// ========================================================================= //
+Tokenizer::Tokenizer(Reader &r)
+    : reader(r), line_index(0), line(&reader.next_line()) {
     is_new_line = true;
     indent_stack.push_back(0);
-    get_char();
+    // Prime the lookahead character
+    col = line->indentation + 1;
+    next_char = line->is_eof ? EOF : peek_line_char();
+    mark_token_start();
 }
 
 void Tokenizer::advance_line() {
@@ -19,13 +157,24 @@ void Tokenizer::advance_line() {
     col = line->indentation + 1;
     line_index = 0;
     is_new_line = true;
-        if (line->is_eof) {
+    if (line->is_eof) {
         next_char = EOF;
     } else {
-        next_char = line->text[line_index++];
+        next_char = peek_line_char();
     }
 }
 
+char Tokenizer::peek_line_char() {
+    // The reader strips the '\n' off of each line, so produce it here once
+    // we run off the end of the line's text
+    char value = '\n';
+    if (line_index < line->length) {
+        value = line->text[line_index];
+    }
+    line_index++;
+    return value;
+}
+
 char Tokenizer::get_char() {
     char value = next_char;
     // Do bookkeeping on line/column numbers
@@ -36,72 +185,134 @@ char Tokenizer::get_char() {
         if (line->is_eof) {
             next_char = EOF;
         } else {
-            next_char = line->text[line_index++];
+            next_char = peek_line_char();
         }
     }
     return value;
 }
 
+void Tokenizer::skip(size_t count) {
+    // next_char is at line_index - 1, move the lookahead `count` past it
+    col += count;
+    line_index += count - 1;
+    next_char = peek_line_char();
+}
+
 int Tokenizer::get_ident() {
-    // The actual text of the identifier is saved in "identifier_string"
-    this->identifier_string = "";
-    do {
-        this->identifier_string += this->get_char();
-        // Read all the characters [a-zA-Z0-9]*
-    } while (isalnum(this->next_char) || this->next_char == '_');
+    // Scan the whole identifier straight out of the line: [a-zA-Z0-9_]*
+    const char *start = line->text + line_index - 1;
+    const char *end = line->text + line->length;
+    size_t length = 1 + scan_ident(start + 1, end - start - 1);
+    skip(length);
     // Check if the identifier is one of the keywords,
     // if so, return the keyword token instead of an identifier
-    if (identifier_string == "def") return tokDef;
-    if (identifier_string == "let") return tokLet;
-    if (identifier_string == "re") return tokRe;
-    if (identifier_string == "mut") return tokMut;
-    if (identifier_string == "if") return tokIf;
-    if (identifier_string == "elif") return tokElif;
-    if (identifier_string == "else") return tokElse;
-    if (identifier_string == "for") return tokFor;
-    if (identifier_string == "in") return tokIn;
-    if (identifier_string == "struct") return tokStruct;
-    if (identifier_string == "return") return tokReturn;
-    if (identifier_string == "default") return tokDefault;
-    if (identifier_string == "pass") return tokPass;
-    if (identifier_string == "none") return tokNone;
-    if (identifier_string == "true") return tokTrue;
-    if (identifier_string == "false") return tokFalse;
-    if (identifier_string == "i64") return tokType;
-    return tokIdentifier;
+    int token = keyword_token(start, length);
+    if (token == tokIdentifier) {
+        // The identifier is saved in "identifier_symbol", its text is only
+        // copied the first time we see it
+        identifier_symbol = Symbols().intern(start, length);
+    }
+    return token;
+}
+
+// Reads a run of decimal digits, returns false if it doesn't fit in 64 bits
+static bool read_digits(const char *digits, size_t count, uint64_t *value) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < count; i++) {
+        unsigned digit = digits[i] - '0';
+        if (result > (UINT64_MAX - digit) / 10) return false;
+        result = result * 10 + digit;
+    }
+    *value = result;
+    return true;
+}
+
+// Every power of ten up to 10^22 is exactly representable as a double
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Converts <integer digits>.<fraction digits> to the nearest double
+static double read_float(const char *text, size_t integer_digits,
+                         size_t fraction_digits) {
+    uint64_t integer_part, fraction_part;
+    const char *fraction = text + integer_digits + 1;
+    // When both halves and their combination are exact, one division by an
+    // exact power of ten is correctly rounded
+    if (integer_digits + fraction_digits <= 19 &&
+        fraction_digits <= 22 &&
+        read_digits(text, integer_digits, &integer_part) &&
+        read_digits(fraction, fraction_digits, &fraction_part)) {
+        uint64_t mantissa = integer_part;
+        for (size_t i = 0; i < fraction_digits; i++) mantissa *= 10;
+        mantissa += fraction_part;
+        if (mantissa <= (1ull << 53)) {
+            return static_cast<double>(mantissa) /
+                   exact_powers_of_ten[fraction_digits];
+        }
+    }
+    // Otherwise leave the rounding to the C library
+    std::string copy(text, integer_digits + 1 + fraction_digits);
+    return std::strtod(copy.c_str(), NULL);
 }
 
 int Tokenizer::get_num() {
-    // The actual text of the number is saved in "number_string"
-    number_string = "";
-    do {
-        number_string += get_char();
-    } while (isdigit(next_char));
+    // Numbers are read straight out of the line: [0-9]+(.[0-9]*)?
+    const char *start = line->text + line_index - 1;
+    const char *end = line->text + line->length;
+    size_t integer_digits = 1 + scan_digits(start + 1, end - start - 1);
+    const char *cursor = start + integer_digits;
+    bool is_float = false;
+    size_t fraction_digits = 0;
     // If it has a fractional portion handle it
-    if (next_char == '.') {
-        do {
-            number_string += get_char();
-        } while (isdigit(next_char));
+    if (cursor != end && *cursor == '.') {
+        is_float = true;
+        cursor++;
+        fraction_digits = scan_digits(cursor, end - cursor);
+        cursor += fraction_digits;
     }
+    skip(cursor - start);
     // Numbers aren't allowed to have a letter immediately following them
     // and numbers aren't allowed to have a second decimal point
-    if (isalpha(next_char || next_char == '.')) {
+    if ((class_of(next_char) & CHAR_IDENT_START) || next_char == '.') {
         // If either are found, return a "tokInvalid"
+        token_error = "malformed number literal";
         return tokInvalid;
     }
-    // Our number is fine, report that it was found
-    number_value = std::atof(number_string.c_str());
+    number.is_integer = !is_float;
+    if (is_float) {
+        number.real = read_float(start, integer_digits, fraction_digits);
+        return tokNumber;
+    }
+    uint64_t value;
+    if (!read_digits(start, integer_digits, &value) || value > INT64_MAX) {
+        token_error = "integer literal doesn't fit in an i64";
+        return tokInvalid;
+    }
+    number.integer = value;
     return tokNumber;
 }
 
+void Tokenizer::mark_token_start() {
+    token_line = line->line_number;
+    token_col = col;
+    // The lookahead character is at line_index - 1, unless we're at the end
+    token_offset = line->offset;
+    if (!line->is_eof) token_offset += line_index - 1;
+}
+
 int Tokenizer::get_token() {
     // Clean out any whitespace between tokens
     // We do this before new line handling, even though all new lines
     // should start with a character (the reader strips the indentation)
     // because we need it before comments
-    while (isblank(next_char)) {
-        get_char();
+    if (class_of(next_char) & CHAR_BLANK) {
+        // A blank lookahead is always inside the line's text
+        size_t index = line_index - 1;
+        skip(scan_blanks(line->text + index, line->length - index));
     }
+    mark_token_start();
     // Strip comments before handling new lines, because comments don't have
     // to follow indentation rules
     if (next_char == '#') {
@@ -133,46 +344,26 @@ int Tokenizer::get_token() {
         // so we don't need to submit any tokens
         is_new_line = false;
     }
+    unsigned char char_type = class_of(next_char);
     // Identifiers: [a-zA-Z_][a-zA-Z0-9_]*
-    if (isalpha(next_char) || next_char == '_') {
+    if (char_type & CHAR_IDENT_START) {
         return get_ident();
     }
     // Numbers: [0-9]+(.[0-9]*)?
-    if (isdigit(next_char)) {
+    if (char_type & CHAR_DIGIT) {
         return get_num();
     }
-    // Handle multi-character tokens
-    // ->
-    if (next_char == '-') {
-        get_char();  // Consume '-'
-        if (next_char == '>') {
-            // We've found a "produces" token (->)
-            get_char();  // Consume '>'
-            return tokProduces;
-        }
-        return '-';
-    }
-
-    // ==
-    if (next_char == '=') {
-        get_char();  // Consume '='
-        if (next_char == '=') {
-            // We've found an "equality" token (==)
-            get_char();  // Consume '='
-            return tokEq;
-        }
-        return '=';
-    }
-
-    // !=
-    if (next_char == '!') {
-        get_char();  // Consume '!'
-        if (next_char == '=') {
-            // We've found an "inequality" token (!=)
-            get_char();  // Consume '='
-            return tokIneq;
+    // Handle multi-character tokens (->, ==, !=), if the second character
+    // doesn't match then it's just the single character token
+    if (char_type & CHAR_OPERATOR) {
+        const OperatorRule &rule =
+            operator_rules[static_cast<unsigned char>(next_char)];
+        int value = get_char();  // Consume the first character
+        if (next_char == rule.second) {
+            get_char();  // Consume the second character
+            return rule.token;
         }
-        return '!';
+        return value;
     }
 
     // Recognize EOF
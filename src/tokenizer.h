@@ -2,9 +2,13 @@
 #ifndef LENS_TOKENIZER_H_
 #define LENS_TOKENIZER_H_ 1
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "src/symbol.h"
+
 class Reader;
 struct Line;
 
@@ -64,25 +68,40 @@ enum Tokens {
     tokType
 };
 
+// The value of a number token. Integer literals are kept exactly, anything
+// with a decimal point is a double.
+struct NumberLiteral {
+    bool is_integer;
+    int64_t integer;
+    double real;
+};
+
 class Tokenizer {
     Reader &reader;
     std::vector<int> indent_stack;
     bool is_new_line;
-    int line_index;
+    // Index into the current line's text of the character after next_char
+    size_t line_index;
  public:
     explicit Tokenizer(Reader &r);
-    std::string identifier_string;
-    std::string number_string;
-    double number_value;
+    Symbol identifier_symbol;
+    NumberLiteral number;
     std::string token_error;
     const Line *line;
     int col;
     char next_char;
+    // Where the most recent token started
+    int token_line;
+    int token_col;
+    size_t token_offset;
 
     char get_char();
     int get_token();
  private:
     void advance_line();
+    char peek_line_char();
+    void skip(size_t count);
+    void mark_token_start();
     int get_num();
     int get_ident();
 };
@@ -0,0 +1,153 @@
+// Copyright (c) 2015 Caleb Jones
+#include "src/vm.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "src/arith.h"
+
+#define RUNTIME_ERROR(msg, ...) (printf("Runtime error: " msg "\n", \
+##__VA_ARGS__), false)
+
+// Registers for all of the frames, and how deep calls can go
+static const size_t kStackSize = 1 << 20;
+static const size_t kMaxCallDepth = 1 << 18;
+
+struct ThreadedInstruction {
+    const void *handler;
+    uint16_t a, b, c;
+};
+
+struct ThreadedFunction {
+    const int64_t *constants;
+    uint32_t register_count;
+    std::vector<ThreadedInstruction> code;
+};
+
+// Where to go back to when a call returns
+struct Frame {
+    const ThreadedInstruction *call;
+    int64_t *registers;
+    const ThreadedFunction *function;
+};
+
+bool run_bytecode(const BytecodeProgram &program, int *exit_code) {
+    if (program.main < 0) {
+        fprintf(stderr, "There's no top level code to run\n");
+        return false;
+    }
+
+    // In the same order as OPCODES
+    static const void *const handlers[NUM_OPCODES] = {
+        &&op_loadi, &&op_loadk, &&op_move,
+        &&op_add, &&op_sub, &&op_mul, &&op_div,
+        &&op_lt, &&op_gt, &&op_eq, &&op_ne,
+        &&op_jump, &&op_jump_if_zero, &&op_call, &&op_print, &&op_return,
+        &&op_shl,
+    };
+    std::vector<ThreadedFunction> functions(program.functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        const BytecodeFunction &function = program.functions[i];
+        functions[i].constants = function.constants.data();
+        functions[i].register_count = function.register_count;
+        for (auto in = function.code.begin(); in != function.code.end();
+             in++) {
+            ThreadedInstruction threaded = {handlers[in->op], in->a, in->b,
+                                            in->c};
+            functions[i].code.push_back(threaded);
+        }
+    }
+
+    // Left uninitialized, so only the pages that get used are touched
+    std::unique_ptr<int64_t[]> stack(new int64_t[kStackSize]);
+    int64_t *stack_end = stack.get() + kStackSize;
+    std::vector<Frame> frames;
+    const ThreadedFunction *function = &functions[program.main];
+    if (function->register_count > kStackSize) {
+        return RUNTIME_ERROR("stack overflow");
+    }
+    // The current frame's registers
+    int64_t *R = stack.get();
+    const ThreadedInstruction *pc = function->code.data();
+
+#define DISPATCH() goto *pc->handler
+#define WIDE(in) (static_cast<uint32_t>((in)->b) << 16 | (in)->c)
+#define BINARY(expr) R[pc->a] = (expr); pc++; DISPATCH()
+
+    DISPATCH();
+
+op_loadi:
+    R[pc->a] = static_cast<int32_t>(WIDE(pc));
+    pc++;
+    DISPATCH();
+op_loadk:
+    R[pc->a] = function->constants[WIDE(pc)];
+    pc++;
+    DISPATCH();
+op_move:
+    R[pc->a] = R[pc->b];
+    pc++;
+    DISPATCH();
+op_add: BINARY(wrapping_add(R[pc->b], R[pc->c]));
+op_sub: BINARY(wrapping_sub(R[pc->b], R[pc->c]));
+op_mul: BINARY(wrapping_mul(R[pc->b], R[pc->c]));
+op_div:
+    if (R[pc->c] == 0) return RUNTIME_ERROR("division by zero");
+    BINARY(wrapping_div(R[pc->b], R[pc->c]));
+op_lt: BINARY(R[pc->b] < R[pc->c]);
+op_gt: BINARY(R[pc->b] > R[pc->c]);
+op_eq: BINARY(R[pc->b] == R[pc->c]);
+op_ne: BINARY(R[pc->b] != R[pc->c]);
+op_shl: BINARY(wrapping_shl(R[pc->b], R[pc->c]));
+op_jump:
+    pc = function->code.data() + WIDE(pc);
+    DISPATCH();
+op_jump_if_zero:
+    if (R[pc->a] == 0) {
+        pc = function->code.data() + WIDE(pc);
+    } else {
+        pc++;
+    }
+    DISPATCH();
+op_call: {
+    const ThreadedFunction *callee = &functions[pc->b];
+    int64_t *callee_registers = R + pc->c;
+    if (callee->register_count > stack_end - callee_registers ||
+        frames.size() == kMaxCallDepth) {
+        return RUNTIME_ERROR("stack overflow");
+    }
+    Frame frame = {pc, R, function};
+    frames.push_back(frame);
+    function = callee;
+    R = callee_registers;
+    pc = callee->code.data();
+    DISPATCH();
+}
+op_print:
+    printf("%li\n", static_cast<long>(R[pc->a]));
+    pc++;
+    DISPATCH();
+op_return: {
+    int64_t result = R[pc->a];
+    if (frames.empty()) {
+        // main returns an i32
+        *exit_code = static_cast<int32_t>(result);
+        fflush(stdout);
+        return true;
+    }
+    const Frame &frame = frames.back();
+    pc = frame.call;
+    R = frame.registers;
+    function = frame.function;
+    frames.pop_back();
+    R[pc->a] = result;
+    pc++;
+    DISPATCH();
+}
+
+#undef BINARY
+#undef WIDE
+#undef DISPATCH
+}
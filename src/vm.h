@@ -0,0 +1,19 @@
+// Copyright (c) 2015 Caleb Jones
+#ifndef LENS_VM_H_
+#define LENS_VM_H_
+
+#include "src/bytecode.h"
+
+// Runs the main function of a verified `program`, putting what it returned
+// in `exit_code`. Returns false if there's no main, or if the program fails
+// (dividing by zero, or recursing too deep), after printing why.
+//
+// Before running, each instruction is threaded: its opcode is replaced by
+// the address of the code that runs it, and each piece of code jumps
+// straight to the next instruction's (with GCC's computed goto), instead of
+// going back to a switch. Every function has a frame of registers on one
+// stack, and a call's arguments are the first registers of the callee's
+// frame, so they're never copied.
+bool run_bytecode(const BytecodeProgram &program, int *exit_code);
+
+#endif  // LENS_VM_H_